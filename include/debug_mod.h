@@ -87,6 +87,61 @@ char debug_mod_init(
     const char* restrict context	///< [in] Name of the calling function
 );
 
+#ifdef DEBUG_MOD_UNREGISTER
+///@brief Remove a debug module from the central list
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_UNREGISTER, which also makes DEBUG_MOD_INIT() call this
+/// function automatically when a shared object is unloaded or the
+/// program exits.  The module's output is disabled and its list slot
+/// is reused for the next registration.
+///
+///@return Non-zero if the module was found and removed
+char debug_mod_unregister(
+    debug_mod* self			///< [in] The module's debug configuration
+);
+#endif
+
+///@brief Output prepare function which enables output without a prefix
+///
+///@see debug_mod_f
+char debug_mod_always(
+    debug_mod* self,			///< [in] The module's debug configuration
+    const char* restrict context	///< [in] Name of the calling function
+);
+
+#ifdef DEBUG_MOD_LINE
+///@brief Start assembling one line of output in a thread-local buffer
+///
+/// Calls the output prepare function on a copy of the module
+/// configuration, whose stream writes into a buffer taken from a
+/// fixed arena for the calling thread.  If no buffer is available,
+/// e.g. for nested output from within a line, the module
+/// configuration itself is prepared and returned as usual.
+///
+///@return Configuration to use for the output or NULL if disabled
+debug_mod* debug_mod_line_begin(
+    debug_mod* self,			///< [in] The module's debug configuration
+    const char* restrict context	///< [in] Name of the calling function
+);
+
+///@brief Write out the assembled line with a single call
+void debug_mod_line_end(
+    debug_mod* line			///< [in] Result of debug_mod_line_begin()
+);
+#endif
+
+///@brief Check whether debugging is enabled for a module
+///
+/// In contrast to a DEBUG_CONDITION, the output prepare function is
+/// never called, so no output is produced.  A module which was not
+/// used before is lazily registered using debug_mod_preinit().
+///
+///@return Non-zero if an output prepare function is configured
+char debug_mod_enabled(
+    debug_mod* self			///< [in] The module's debug configuration
+);
+
 
 ///@name Setup functions
 ///@{
@@ -97,6 +152,16 @@ char debug_mod_init(
 /// Compile time switch to enable debug output
 #define DEBUG_MOD_ENABLE 1	//dummy value for true condition
 
+#ifdef DEBUG_MOD_UNREGISTER
+/// Remove the module from the central list when its code is unloaded
+#define _DEBUG_MOD_FINI					\
+    static void __attribute__((destructor))		\
+    _debug_mod_fini(void)				\
+    { debug_mod_unregister(&_debug_mod); }
+#else
+#define _DEBUG_MOD_FINI
+#endif
+
 ///@brief Set up debugging for the current module
 ///
 /// Calling this macro once per module is a prerequisite to use any
@@ -108,7 +173,8 @@ char debug_mod_init(
 	.func	= debug_mod_init,		\
 	.stream	= NULL,				\
 	.module	= (modulestring),		\
-    };
+    };						\
+    _DEBUG_MOD_FINI
 
 #else //DEBUG_MOD_ENABLE not defined
 
@@ -161,6 +227,68 @@ char debug_mod_init(
     if (DEBUG_MOD_ENABLE && _debug_mod.func &&	\
 	_debug_mod.func(&_debug_mod, DEBUG_MOD_CONTEXT))
 
+/// Expression to check if debugging is enabled, without calling the
+/// output prepare function
+#define DEBUG_ENABLED				\
+    (DEBUG_MOD_ENABLE && _debug_mod.func &&	\
+     debug_mod_enabled(&_debug_mod))
+
+#if defined(DEBUG_MOD_SDT) && defined(__ELF__) && defined(__GNUC__)
+/// Address size in the probe note, matching the target's pointers
+#ifdef __LP64__
+#define _DEBUG_MOD_SDT_ADDR	".8byte"
+#else
+#define _DEBUG_MOD_SDT_ADDR	".4byte"
+#endif
+
+///@brief Place a SystemTap SDT probe debug_mod:output at the call site
+///
+/// Only a single NOP is emitted in the code, while an ELF note in the
+/// format of <sys/sdt.h> tells tracers like bpftrace or perf where to
+/// find it and how to read the arguments: module identifier, context
+/// and the first argument for the output function, usually the format
+/// string.  The latter is only passed if it is a compile-time
+/// constant, otherwise the probe gets zero and the argument is not
+/// evaluated.  The probe fires whether the module is enabled or not.
+///
+///@param arg	First argument for the output function
+#define _DEBUG_MOD_PROBE(arg)						\
+    __asm__ __volatile__ (						\
+	"990: nop\n"							\
+	".pushsection .note.stapsdt,\"?\",\"note\"\n"			\
+	".balign 4\n"							\
+	".4byte 992f-991f, 994f-993f, 3\n"				\
+	"991: .asciz \"stapsdt\"\n"					\
+	"992: .balign 4\n"						\
+	"993: " _DEBUG_MOD_SDT_ADDR " 990b\n"				\
+	_DEBUG_MOD_SDT_ADDR " _.stapsdt.base\n"				\
+	_DEBUG_MOD_SDT_ADDR " 0\n"	/* no semaphore */		\
+	".asciz \"debug_mod\"\n"						\
+	".asciz \"output\"\n"						\
+	".asciz \"%c0@%1 %c2@%3 %c4@%5\"\n"				\
+	"994: .balign 4\n"						\
+	".popsection\n"							\
+	".ifndef _.stapsdt.base\n"					\
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n"						\
+	".hidden _.stapsdt.base\n"					\
+	"_.stapsdt.base: .space 1\n"					\
+	".size _.stapsdt.base, 1\n"					\
+	".popsection\n"							\
+	".endif\n"							\
+	:: "n" (sizeof(_debug_mod.module)), "nor" (_debug_mod.module),	\
+	   "n" (sizeof(DEBUG_MOD_CONTEXT + 0)), "nor" (DEBUG_MOD_CONTEXT + 0), \
+	   "n" (sizeof(__UINTPTR_TYPE__)),				\
+	   "nor" ((__UINTPTR_TYPE__) __builtin_choose_expr(		\
+		   __builtin_constant_p(arg), (arg), 0)))
+#else
+#define _DEBUG_MOD_PROBE(arg)
+#endif
+
+/// Select the first of the arguments, which must not be empty
+#define _DEBUG_MOD_FIRST(...)	_DEBUG_MOD_FIRST_(__VA_ARGS__, 0)
+#define _DEBUG_MOD_FIRST_(first, ...)	first
+
 ///@brief Call function with configured stream as first argument.
 ///
 /// The DEBUG_CONDITION macro is evaluated first, calling any output
@@ -168,24 +296,53 @@ char debug_mod_init(
 /// is generated with the configured stream passed as its first
 /// parameter.
 ///
+/// With DEBUG_MOD_LINE, the stream passed to the output prepare
+/// function and f is a thread-local line buffer, which is written to
+/// the configured stream afterwards using a single call.
+///
+/// With DEBUG_MOD_SDT, every call site also carries a probe point for
+/// dynamic tracing, see _DEBUG_MOD_PROBE().
+///
 ///@param f	Debug output function
 ///@param ...	Additional trailing arguments passed to function
+#if defined(DEBUG_MOD_LINE) && DEBUG_MOD_ENABLE
+#define DEBUGF(f, ...) {					\
+	debug_mod* _debug_mod_line;				\
+	_DEBUG_MOD_PROBE(_DEBUG_MOD_FIRST(__VA_ARGS__));	\
+	if (_debug_mod.func && (_debug_mod_line =		\
+	    debug_mod_line_begin(&_debug_mod, DEBUG_MOD_CONTEXT))) { \
+	    f(_debug_mod_line->stream, __VA_ARGS__);		\
+	    debug_mod_line_end(_debug_mod_line); } }
+#else
 #define DEBUGF(f, ...) {				\
+	_DEBUG_MOD_PROBE(_DEBUG_MOD_FIRST(__VA_ARGS__));	\
 	DEBUG_CONDITION					\
 	    f(debug_mod_get_stream(), __VA_ARGS__); }
+#endif
 
 ///@brief Call function with configured stream as last argument.
 ///
 /// The DEBUG_CONDITION macro is evaluated first, calling any output
 /// prepare function if set.  On success, a call to the given function
 /// is generated with the configured stream passed as its last
-/// parameter.
+/// parameter.  See DEBUGF() regarding DEBUG_MOD_LINE and DEBUG_MOD_SDT.
 ///
 ///@param f	Debug output function
 ///@param ...	Additional leading arguments passed to function
+#if defined(DEBUG_MOD_LINE) && DEBUG_MOD_ENABLE
+#define DEBUGL(f, ...) {					\
+	debug_mod* _debug_mod_line;				\
+	_DEBUG_MOD_PROBE(_DEBUG_MOD_FIRST(__VA_ARGS__));	\
+	if (_debug_mod.func && (_debug_mod_line =		\
+	    debug_mod_line_begin(&_debug_mod, DEBUG_MOD_CONTEXT))) { \
+	    f(__VA_ARGS__, _debug_mod_line->stream);		\
+	    debug_mod_line_end(_debug_mod_line); } }
+#else
 #define DEBUGL(f, ...) {				\
+	_DEBUG_MOD_PROBE(_DEBUG_MOD_FIRST(__VA_ARGS__));	\
 	DEBUG_CONDITION					\
 	    f(__VA_ARGS__, debug_mod_get_stream()); }
+#endif
 
 ///@}
 
@@ -45,7 +45,8 @@ extern const debug_mod_index_t debug_mod_max;
 /// settings are copied to the new structure provided and its address
 /// is recorded for later reconfiguration.
 ///
-///@return - Negative for newly registered module
+///@return - Negative for newly registered module, -2 if its
+///          configuration was taken from the boot specification
 ///        - Positive if a previous configuration was overwritten
 ///        - Zero on failure (list full)
 char debug_mod_register(
@@ -101,7 +102,7 @@ void debug_mod_disable(
 /// The returned pointer provides access to the configuration for all
 /// known modules through a list of addresses.  The number of elements
 /// is returned in the size parameter.  The list may contain NULL
-/// values.
+/// values, e.g. for released slots.
 ///
 ///@return Start of the address list or NULL on error (wrong argument)
 debug_mod *const * debug_mod_list(
@@ -133,4 +134,155 @@ debug_mod_index_t debug_mod_restore(
 ///@}
 #endif //DEBUG_MOD_SAVE
 
+
+#ifdef DEBUG_MOD_BOOT
+///@name Boot configuration from environment or configuration file
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_BOOT before including this header file.
+///
+/// The specification is a list of entries separated by commas or
+/// white space, where a hash sign starts a comment until the end of
+/// the line.  Each entry has the form
+///
+///     [-]pattern[:target]
+///
+/// The pattern is a module identifier or a prefix followed by "*".
+/// An exact match takes precedence over the longest matching prefix.
+/// A leading "-" disables matching modules, otherwise they are
+/// enabled with debug_mod_default_func or debug_mod_always() if that
+/// is not set.  The target is "stderr" (default), "stdout" or a file
+/// name to append to.  Files are opened on first use and shared
+/// between all modules with the same target.
+///
+/// Unless a specification is loaded explicitly, the environment
+/// variable DEBUGMOD is parsed during the first registration.  If
+/// DEBUGMOD_FILE is set instead, the specification is read from the
+/// named file.  Each newly registered module is then configured
+/// according to the parsed table.
+///
+///@{
+
+///@brief Load a boot configuration specification
+///
+/// Replaces any previously loaded specification.  Modules which are
+/// already registered are not changed.  A rejected specification
+/// leaves no entries loaded.
+///
+///@return Number of entries parsed or negative on error (too long or
+///	   too many entries)
+int debug_mod_boot(
+    const char* spec			///< [in] Specification string
+);
+
+///@brief Load a boot configuration specification from a file
+///
+///@return Number of entries parsed or negative on error
+int debug_mod_boot_file(
+    const char* path			///< [in] Name of the configuration file
+);
+
+///@}
+#endif //DEBUG_MOD_BOOT
+
+
+#ifdef DEBUG_MOD_COMMAND
+///@name Text command interpreter
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_COMMAND before including this header file.
+///
+/// A batch consists of commands separated by semicolons or newlines,
+/// where a hash sign starts a comment until the end of the line.
+/// Words within a command are separated by blanks.  The commands are
+///
+///     pattern +[stream]	enable, optionally switching the stream
+///     pattern -		disable
+///     +pattern		enable, keeping the stream
+///     -pattern		disable
+///     list [pattern]	write the state of each module to out
+///
+/// The pattern is a registered module identifier, a prefix followed
+/// by "*", or "all".  Enabled modules keep their output prepare
+/// function or get debug_mod_default_func, or debug_mod_always() if
+/// that is not set.  The stream is "stderr" or "stdout".  Each line
+/// written by "list" holds the identifier, "+" or "-" and the stream
+/// name if it is one of those two.
+///
+///@{
+
+///@brief Parse and apply a batch of text commands
+///
+/// The whole batch is parsed first.  On any error, including unknown
+/// module identifiers, a message is written to out and no command is
+/// applied.  Otherwise, the commands are applied in order.  Exact
+/// identifiers are resolved through a hash index over the registered
+/// modules, which is rebuilt when needed.  No memory is allocated.
+///
+///@return Number of commands applied or negative on error
+int debug_mod_command(
+    const char* commands,		///< [in] Command batch
+    FILE* out				///< [in] Stream for replies, may be NULL
+);
+
+///@}
+#endif //DEBUG_MOD_COMMAND
+
+
+#ifdef DEBUG_MOD_CRASH
+///@name Crash drain for buffered output
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_CRASH before including this header file.
+///
+///@{
+
+///@brief Install a handler to save buffered output on fatal signals
+///
+/// On SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT, the output still
+/// pending in each registered module's stream is written out using
+/// only async-signal-safe calls.  This covers the stdio buffers of
+/// regular streams (GNU C library only) and the buffers of library
+/// sinks from debug_mod_sink.h.  A final marker line is appended to
+/// each stream, then the previously installed handler is called or
+/// the default action is taken.
+///
+/// For stack overflows to be handled, the handler runs on an
+/// alternate signal stack, which is only set up for the calling
+/// thread.  An alternate stack already installed by the application
+/// or a runtime is kept.
+///
+///@return Zero on success, non-zero on error
+int debug_mod_crash_install(void);
+
+///@}
+#endif //DEBUG_MOD_CRASH
+
+
+#ifdef DEBUG_MOD_HIST
+///@name Latency histogram statistics
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_HIST before including this header file.  Histograms are
+/// filled through DEBUG_TIME_SCOPE() from debug_mod_trace.h.
+///
+///@{
+
+///@brief Write percentile statistics for all timed contexts
+///
+/// One line is written per histogram, listing the module, context,
+/// number of samples and the 50th, 99th and 99.9th percentile as well
+/// as the maximum of the elapsed time in nanoseconds.
+///
+///@return Number of histograms written
+debug_mod_index_t debug_mod_hist_dump(
+    FILE* stream			///< [in] Where to write the statistics
+);
+
+///@brief Discard all samples recorded so far
+void debug_mod_hist_reset(void);
+
+///@}
+#endif //DEBUG_MOD_HIST
+
 #endif //DEBUG_MOD_CONTROL_H_
@@ -0,0 +1,301 @@
+///@file
+///@brief	Output streams provided by the library
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#ifndef DEBUG_MOD_SINK_H_
+#define DEBUG_MOD_SINK_H_
+
+#include "debug_mod.h"
+
+
+// Each sink is a standard stream, to be used as a module's output
+// stream through debug_mod_set_stream(), debug_mod_register() or
+// debug_mod_update().  Close it with fclose() after all modules have
+// stopped using it.
+
+
+#ifdef DEBUG_MOD_ASYNC
+///@name Asynchronous file sink
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_ASYNC before including this header file.  Requires POSIX
+/// threads and fopencookie().
+///
+///@{
+
+///@brief Create a stream which writes to a file descriptor in the background
+///
+/// Output is copied into a fixed-size ring buffer and written out by
+/// a worker thread in large batches, so the writing thread never
+/// blocks on the file descriptor.  Output which does not fit into the
+/// ring buffer is dropped and accounted for.  The file descriptor is
+/// owned by the stream and closed by fclose().  If the program exits
+/// without fclose(), remaining output is still written out.
+///
+///@return New line-buffered stream or NULL if no sink is available
+FILE* debug_mod_async_open(
+    int fd				///< [in] File descriptor to write to
+);
+
+///@brief Number of bytes dropped because the ring buffer was full
+///
+///@return Byte count, or zero if the stream is not an asynchronous sink
+unsigned long debug_mod_async_dropped(
+    FILE* stream			///< [in] Stream from debug_mod_async_open()
+);
+
+///@}
+#endif //DEBUG_MOD_ASYNC
+
+
+#ifdef DEBUG_MOD_LZ
+///@name Compressing sink
+///
+/// Must be enabled at compile time by defining the macro DEBUG_MOD_LZ
+/// before including this header file.  Requires fopencookie().
+///
+///@{
+
+///@brief Create a stream which compresses all output into another stream
+///
+/// Output is collected in blocks of DEBUG_MOD_LZ_BLOCK bytes, which
+/// are compressed in LZ4 block format and written to the given
+/// stream.  A block is also finished whenever the returned stream is
+/// flushed with fflush().  The target stream is flushed after each
+/// block.  The crash handler writes out the last incomplete block
+/// uncompressed, if the target is a regular file or a library sink.
+/// The target is not closed together with the returned stream.
+///
+/// Use the debug_mod_unlz tool to decompress the written data.
+///
+///@return New fully buffered stream or NULL if no sink is available
+FILE* debug_mod_lz_open(
+    FILE* target			///< [in] Stream receiving the compressed data
+);
+
+///@}
+#endif //DEBUG_MOD_LZ
+
+
+#ifdef DEBUG_MOD_FANOUT
+///@name Fan-out sink
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_FANOUT before including this header file.  Requires
+/// fopencookie().
+///
+///@{
+
+///@brief Create a stream which passes on its output to several other streams
+///
+/// Each line is formatted only once into the stream's line buffer
+/// and then written unchanged to every enabled target, which may
+/// itself be any stream including the other sinks.  Targets are not
+/// closed together with the returned stream.
+///
+/// Modules needing different targets, e.g. verbose ones only going
+/// to a file, use separate fan-out sinks sharing some targets.
+///
+///@return New line-buffered stream or NULL if no sink is available
+FILE* debug_mod_fanout_open(void);
+
+///@brief Add a target stream, enabled right away
+///
+///@return Zero on success, non-zero if the target table is full
+int debug_mod_fanout_add(
+    FILE* fanout,			///< [in] Stream from debug_mod_fanout_open()
+    FILE* target			///< [in] Stream to receive the output
+);
+
+///@brief Stop passing on output to a target stream
+///
+/// Any pending output is flushed to all targets first.
+void debug_mod_fanout_remove(
+    FILE* fanout,			///< [in] Stream from debug_mod_fanout_open()
+    FILE* target			///< [in] Previously added stream
+);
+
+///@brief Temporarily enable or disable output to a target stream
+///
+///@return Zero on success, non-zero if the target is unknown
+int debug_mod_fanout_enable(
+    FILE* fanout,			///< [in] Stream from debug_mod_fanout_open()
+    FILE* target,			///< [in] Previously added stream
+    char enable				///< [in] Non-zero to pass on output
+);
+
+///@}
+#endif //DEBUG_MOD_FANOUT
+
+
+#ifdef DEBUG_MOD_DEDUP
+///@name Duplicate suppressing sink
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_DEDUP before including this header file.  Requires
+/// fopencookie().
+///
+///@{
+
+///@brief Create a stream which drops immediate repetitions of a line
+///
+/// Each complete line is compared to the previous one through a hash
+/// and passed on to the target stream only if it differs.  The number
+/// of dropped repetitions is reported in a summary line when a
+/// different line arrives, when the stream is closed, or on a crash.
+/// There is no timer, but during a long storm the summary is also
+/// written with the first repetition arriving DEBUG_MOD_DEDUP_WINDOW
+/// milliseconds after the storm began.  Lines longer than
+/// DEBUG_MOD_DEDUP_LINE bytes are always passed on.  The target
+/// stream is not closed together with the returned stream.
+///
+///@return New line-buffered stream or NULL if no sink is available
+FILE* debug_mod_dedup_open(
+    FILE* target			///< [in] Stream receiving the filtered output
+);
+
+///@}
+#endif //DEBUG_MOD_DEDUP
+
+
+#ifdef DEBUG_MOD_PIPE
+///@name Backpressure sink
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_PIPE before including this header file.  Requires
+/// poll() and fopencookie().
+///
+///@{
+
+/// Behaviour when the consumer does not keep up with the output
+typedef enum {
+    /// Wait until the consumer accepts the output
+    DEBUG_MOD_PIPE_BLOCK,
+    /// Discard new output while the buffer is full
+    DEBUG_MOD_PIPE_DROP_NEWEST,
+    /// Discard the oldest buffered lines to make room for new output
+    DEBUG_MOD_PIPE_DROP_OLDEST,
+} debug_mod_pipe_policy;
+
+///@brief Create a stream which writes to a pipe or socket without stalling
+///
+/// The file descriptor is switched to non-blocking mode.  Output it
+/// does not accept right away is kept in a buffer of
+/// DEBUG_MOD_PIPE_BUFFER bytes and written out with later output.
+/// When the buffer is full, the policy decides which output is
+/// dropped, or waits for the consumer.  Once the buffer could be
+/// written out completely, the dropped amount is reported by a line
+/// in the output itself.  The file descriptor is owned by the stream
+/// and closed by fclose(), which waits up to DEBUG_MOD_PIPE_LINGER
+/// milliseconds for the consumer to take the rest of the buffer.
+///
+/// Non-blocking mode applies to the whole open file description, so
+/// it also affects descriptors sharing it, e.g. the original of a
+/// dup() copy, until fclose() restores the previous mode.
+///
+///@return New line-buffered stream or NULL if no sink is available
+FILE* debug_mod_pipe_open(
+    int fd,				///< [in] File descriptor to write to
+    debug_mod_pipe_policy policy	///< [in] Initial backpressure policy
+);
+
+///@brief Change the backpressure policy of a stream
+///
+///@return Zero on success, non-zero if the stream is not a backpressure sink
+int debug_mod_pipe_set_policy(
+    FILE* stream,			///< [in] Stream from debug_mod_pipe_open()
+    debug_mod_pipe_policy policy	///< [in] New backpressure policy
+);
+
+///@brief Number of bytes dropped because the consumer did not keep up
+///
+///@return Byte count, or zero if the stream is not a backpressure sink
+unsigned long debug_mod_pipe_dropped(
+    FILE* stream			///< [in] Stream from debug_mod_pipe_open()
+);
+
+///@}
+#endif //DEBUG_MOD_PIPE
+
+
+#ifdef DEBUG_MOD_FILE
+///@name Per-module file sinks
+///
+/// Must be enabled at compile time by defining the macro
+/// DEBUG_MOD_FILE before including this header file.  Requires POSIX
+/// threads and fopencookie().
+///
+/// The library keeps a cache of up to DEBUG_MOD_FILE_SINKS files,
+/// each opened once with O_APPEND and shared by all modules writing
+/// to the same path.  Output is collected in a buffer of
+/// DEBUG_MOD_FILE_BUFFER bytes per file, which is written out when
+/// full, or after a complete line once DEBUG_MOD_FILE_INTERVAL
+/// milliseconds have passed since the last write.  Remaining output
+/// is written at program exit.  The streams are owned by the library
+/// and must not be closed.  Only modules count as users of a file, so
+/// the streams must not be used as targets of other sinks such as a
+/// fan-out, which could be left writing to a closed file.
+///
+///@{
+
+///@brief Direct the output of one or all registered modules to a file
+///
+/// A path ending in a slash names a directory, in which each module
+/// writes its own file named after the module identifier plus
+/// ".log", with slashes replaced by underscores.  Only the stream is
+/// changed, not whether output is enabled.  If the cache is full, the
+/// least recently selected file no module writes to anymore is
+/// closed.  A thread which read a module's stream before it was
+/// switched may still be writing to that file, so more distinct paths
+/// than DEBUG_MOD_FILE_SINKS must only be selected while no other
+/// thread produces output for the switched modules.
+///
+///@return Number of modules switched or negative if a file could not be opened
+int debug_mod_file_select(
+    const char* module,			///< [in] Module to configure or NULL for all known
+    const char* path			///< [in] File or directory to write to
+);
+
+///@brief Write out the buffers of all files now
+///
+/// Useful during idle periods, when no further output would trigger
+/// the periodic write.
+void debug_mod_file_flush(void);
+
+///@brief Reopen all files by path with their next output
+///
+/// Only sets a flag, so it can be called from a signal handler.  If a
+/// file cannot be reopened, output continues to the old one.
+void debug_mod_file_reopen(void);
+
+///@brief Call debug_mod_file_reopen() whenever SIGHUP is received
+///
+/// Any previously installed handler function is still called.
+///
+///@return Zero on success, non-zero if the handler could not be installed
+int debug_mod_file_sighup(void);
+
+///@}
+#endif //DEBUG_MOD_FILE
+
+
+#endif //DEBUG_MOD_SINK_H_
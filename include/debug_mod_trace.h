@@ -0,0 +1,209 @@
+///@file
+///@brief	Scoped tracing API with Chrome trace-event output
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#ifndef DEBUG_MOD_TRACE_H_
+#define DEBUG_MOD_TRACE_H_
+
+#include "debug_mod.h"
+
+#include <stdint.h>	//for uint64_t
+
+
+/// State of a traced scope, closed automatically when leaving it
+typedef struct debug_mod_scope {
+    /// Module which recorded the begin event, NULL if disabled
+    const debug_mod*	mod;
+    /// Context string of the begin event
+    const char*		context;
+} debug_mod_scope;
+
+
+/// Latency histogram for one context, allocated by the library
+typedef struct debug_mod_hist debug_mod_hist;
+
+/// State of a timed scope, recorded automatically when leaving it
+typedef struct debug_mod_timer {
+    /// Histogram to record into, NULL if disabled
+    debug_mod_hist*	hist;
+    /// Monotonic timestamp in nanoseconds when entering the scope
+    uint64_t		start;
+} debug_mod_timer;
+
+
+///@name Trace event recording
+///
+/// The library must be compiled with the macro DEBUG_MOD_TRACE
+/// defined.  Events are stored in fixed-size per-thread buffers
+/// without any locking.  Context strings are referenced, not copied,
+/// so they must have static storage duration (like __func__).
+///
+///@{
+
+///@brief Record a begin event for the calling thread
+///
+///@return The module configuration passed in
+const debug_mod* debug_mod_trace_begin(
+    const debug_mod* self,		///< [in] The module's debug configuration
+    const char* context			///< [in] Name of the traced scope
+);
+
+///@brief Record an end event for the calling thread
+void debug_mod_trace_end(
+    const debug_mod* self,		///< [in] The module's debug configuration
+    const char* context			///< [in] Name of the traced scope
+);
+
+///@brief Write all recorded events in Chrome trace-event JSON format
+///
+/// The output can be loaded in chrome://tracing or Perfetto.  Threads
+/// may keep recording while dumping, but their new events might not
+/// be included.
+///
+///@return Number of events written
+unsigned long debug_mod_trace_dump(
+    FILE* stream			///< [in] Where to write the JSON document
+);
+
+/// Cleanup handler for DEBUG_SCOPE(), records the matching end event
+static inline void
+debug_mod_trace_scope_end(debug_mod_scope* scope)
+{
+    if (scope->mod) debug_mod_trace_end(scope->mod, scope->context);
+}
+
+///@}
+
+
+///@name Latency histogram recording
+///
+/// The library must be compiled with the macro DEBUG_MOD_HIST
+/// defined.  Each histogram is identified by the module and context
+/// string.  Use debug_mod_hist_dump() from debug_mod_control.h to
+/// output the collected statistics.
+///
+///@{
+
+///@brief Start timing a scope
+///
+/// The histogram is looked up only once per call site and cached in
+/// the location given by the site parameter.  If no histogram is
+/// available, the returned timer is disabled.
+///
+///@return Timer to pass to debug_mod_hist_end()
+debug_mod_timer debug_mod_hist_begin(
+    debug_mod_hist** site,		///< [in,out] Cached histogram for the call site
+    const debug_mod* self,		///< [in] The module's debug configuration
+    const char* context			///< [in] Name of the timed scope
+);
+
+///@brief Record the elapsed time of a scope in its histogram
+void debug_mod_hist_end(
+    const debug_mod_timer* timer	///< [in] Timer from debug_mod_hist_begin()
+);
+
+/// Cleanup handler for DEBUG_TIME_SCOPE(), records the elapsed time
+static inline void
+debug_mod_hist_scope_end(debug_mod_timer* timer)
+{
+    if (timer->hist) debug_mod_hist_end(timer);
+}
+
+///@}
+
+
+///@name Tracing macros
+///
+/// Events are only recorded if debugging is enabled for the current
+/// module, see DEBUG_ENABLED.  The output prepare function is not
+/// called.
+///
+///@{
+
+#if DEBUG_MOD_ENABLE
+
+/// Record the beginning of the current context
+#define DEBUG_ENTER() {						\
+	if (DEBUG_ENABLED)					\
+	    debug_mod_trace_begin(&_debug_mod, DEBUG_MOD_CONTEXT); }
+
+/// Record the end of the current context
+#define DEBUG_EXIT() {						\
+	if (DEBUG_ENABLED)					\
+	    debug_mod_trace_end(&_debug_mod, DEBUG_MOD_CONTEXT); }
+
+///@brief Trace the enclosing block from here until it is left
+///
+/// Declares a variable, so it can only be used once per block.  The
+/// end event is recorded on any exit path, even if the module was
+/// disabled in between.
+#define DEBUG_SCOPE()							\
+    debug_mod_scope _debug_mod_scope					\
+    __attribute__((cleanup(debug_mod_trace_scope_end))) = {		\
+	.mod	 = DEBUG_ENABLED					\
+	    ? debug_mod_trace_begin(&_debug_mod, DEBUG_MOD_CONTEXT) : NULL, \
+	.context = DEBUG_MOD_CONTEXT,					\
+    }
+
+#else //DEBUG_MOD_ENABLE not defined
+
+// Without any reference to the library, even if not optimized
+#define DEBUG_ENTER() { (void) _debug_mod; }
+#define DEBUG_EXIT() { (void) _debug_mod; }
+#define DEBUG_SCOPE()							\
+    debug_mod_scope _debug_mod_scope __attribute__((unused)) = {	\
+	.mod	 = ((void) _debug_mod, NULL),				\
+	.context = NULL,						\
+    }
+
+#endif //DEBUG_MOD_ENABLE
+
+#if DEBUG_MOD_ENABLE
+
+///@brief Time the enclosing block from here until it is left
+///
+/// The elapsed time is recorded in a latency histogram for the
+/// current module and context.  Declares variables, so it can only be
+/// used once per block.
+#define DEBUG_TIME_SCOPE()						\
+    static debug_mod_hist* _debug_mod_hist_site = NULL;		\
+    debug_mod_timer _debug_mod_timer					\
+    __attribute__((cleanup(debug_mod_hist_scope_end))) =		\
+	DEBUG_ENABLED							\
+	? debug_mod_hist_begin(&_debug_mod_hist_site,			\
+			       &_debug_mod, DEBUG_MOD_CONTEXT)		\
+	: (debug_mod_timer) { .hist = NULL, .start = 0 }
+
+#else //DEBUG_MOD_ENABLE not defined
+
+#define DEBUG_TIME_SCOPE()						\
+    debug_mod_timer _debug_mod_timer __attribute__((unused)) = {	\
+	.hist	= ((void) _debug_mod, NULL),				\
+	.start	= 0,							\
+    }
+
+#endif //DEBUG_MOD_ENABLE
+
+///@}
+
+
+#endif //DEBUG_MOD_TRACE_H_
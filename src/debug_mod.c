@@ -22,19 +22,23 @@
 
 
 #include <debug_mod_control.h>
+#include "debug_mod_internal.h"
 
 #include <string.h>
 
 
-#ifndef DEBUG_MOD_MAX
-/// Size of the array to track module configurations
-#define DEBUG_MOD_MAX 4
-#endif
-
-
 
 /// List of tracked module configuration structures
 static debug_mod *mods[DEBUG_MOD_MAX] = { NULL };
+/// Number of list slots ever used, any later slots are empty
+static debug_mod_index_t mods_used = 0;
+
+#ifdef DEBUG_MOD_UNREGISTER
+/// Head of the list of released slots, debug_mod_max if empty
+static debug_mod_index_t free_head = DEBUG_MOD_MAX;
+/// Next released slot for each entry on the free list
+static debug_mod_index_t free_next[DEBUG_MOD_MAX];
+#endif
 
 
 
@@ -58,34 +62,91 @@ debug_mod_copy_config(
 char
 debug_mod_register(debug_mod* restrict dm)
 {
+    debug_mod_index_t i;
+
     if (dm && dm->module) {
-	for (debug_mod_index_t i = 0; i < debug_mod_max; ++i) {
-	    if (mods[i] == NULL) {	//first empty slot
-		// Record configuration pointer
-		mods[i] = dm;
-		return -1;
-	    } else if (mods[i]->module &&
-		       0 == strcmp(dm->module, mods[i]->module)) {	//already registered
+	for (i = 0; i < mods_used; ++i) {
+	    if (mods[i] && mods[i]->module &&
+		0 == strcmp(dm->module, mods[i]->module)) {	//already registered
 		// Apply previously stored config
 		debug_mod_copy_config(dm, mods[i]);
 		mods[i] = dm;
 		return 1;
 	    }
 	}
+
+#ifdef DEBUG_MOD_UNREGISTER
+	if (free_head < debug_mod_max) {	//reuse released slot
+	    i = free_head;
+	    free_head = free_next[i];
+	} else
+#endif
+	if (mods_used < debug_mod_max) i = mods_used++;	//first empty slot
+	else i = debug_mod_max;
+
+	if (i < debug_mod_max) {
+	    // Record configuration pointer
+	    mods[i] = dm;
+#ifdef DEBUG_MOD_BOOT
+	    if (debug_mod_boot_apply(dm)) return -2;
+#endif
+	    return -1;
+	}
     }
     // No suitable slot found or parameter error
-    dm->func = NULL;	//avoid recursive function call
+    if (dm) dm->func = NULL;	//avoid recursive function call
     return 0;
 }
 
 
 
+#ifdef DEBUG_MOD_UNREGISTER
+char
+debug_mod_unregister(debug_mod* dm)
+{
+    if (! dm) return 0;
+
+    for (debug_mod_index_t i = 0; i < mods_used; ++i) {
+	if (mods[i] == dm) {
+	    // Put slot on the free list for reuse
+	    mods[i] = NULL;
+	    free_next[i] = free_head;
+	    free_head = i;
+	    dm->func = NULL;
+	    return 1;
+	}
+    }
+    return 0;
+}
+#endif //DEBUG_MOD_UNREGISTER
+
+
+
+#if defined(DEBUG_MOD_UNREGISTER) && defined(DEBUG_MOD_SAVE)
+/// Make sure an empty slot is not handed out again from the free list
+static void
+debug_mod_claim_slot(debug_mod_index_t slot)
+{
+    debug_mod_index_t* link = &free_head;
+
+    while (*link < debug_mod_max) {
+	if (*link == slot) {
+	    *link = free_next[slot];
+	    return;
+	}
+	link = free_next + *link;
+    }
+}
+#endif
+
+
+
 inline void
 debug_mod_preinit(debug_mod* restrict self)
 {
     char r = debug_mod_register(self);
 
-    if (r < 0) {	//new entry registered
+    if (r == -1) {	//new entry registered without boot configuration
 	self->func = debug_mod_default_func;
 	self->stream = stderr;
     }
@@ -104,6 +165,35 @@ debug_mod_init(debug_mod* restrict self,
 
 
 
+char
+debug_mod_always(debug_mod* restrict self __attribute__((unused)),
+		 const char* restrict context __attribute__((unused)))
+{
+    return 1;
+}
+
+
+
+char
+debug_mod_enabled(debug_mod* restrict self)
+{
+    if (self->func == debug_mod_init) debug_mod_preinit(self);
+    return self->func != NULL;
+}
+
+
+
+#ifdef DEBUG_MOD_REGISTRY
+debug_mod *const *
+debug_mod_registry(debug_mod_index_t *size)
+{
+    *size = mods_used;
+    return (debug_mod *const *) mods;
+}
+#endif //DEBUG_MOD_REGISTRY
+
+
+
 #ifdef DEBUG_MOD_DYNAMIC
 ///@brief Update configuration for one or all known modules
 ///
@@ -116,8 +206,8 @@ debug_mod_update_config(
 {
     if (! dm) return;
 
-    for (debug_mod_index_t i = 0; i < debug_mod_max; ++i) {
-	if (mods[i] == NULL) break;	//first empty slot
+    for (debug_mod_index_t i = 0; i < mods_used; ++i) {
+	if (mods[i] == NULL) continue;	//released slot
 	if (! dm->module) {	//no module specified, do all
 	    debug_mod_copy_config(mods[i], dm);
 	} else if (mods[i]->module
@@ -182,9 +272,10 @@ debug_mod_save(debug_mod saved[],
     debug_mod_index_t i;
 
     // Loop through module list
-    for (i = 0; i < sizeof(mods) / sizeof(*mods) && i < size; ++i) {
-	if (mods[i] == NULL) break;	//first empty slot
-	saved[i] = *mods[i];
+    for (i = 0; i < mods_used && i < size; ++i) {
+	if (mods[i] == NULL) {		//released slot
+	    saved[i] = (debug_mod) { .func = NULL, .stream = NULL, .module = NULL };
+	} else saved[i] = *mods[i];
     }
     return i;
 }
@@ -199,7 +290,12 @@ debug_mod_restore(debug_mod saved[],
 
     // Loop through module list
     for (i = 0; i < sizeof(mods) / sizeof(*mods) && i < size; ++i) {
+	if (! saved[i].module) continue;	//released slot
 	if (mods[i] == NULL) {		//empty slot
+#ifdef DEBUG_MOD_UNREGISTER
+	    debug_mod_claim_slot(i);
+#endif
+	    if (i >= mods_used) mods_used = i + 1;
 	    // Point slot to the saved stream configuration
 	    mods[i] = saved + i;
 	} else if (mods[i]->module && saved[i].module &&
@@ -0,0 +1,319 @@
+///@file
+///@brief	Asynchronous file sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie(), clock_gettime()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_ASYNC
+
+#include "debug_mod_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#ifndef DEBUG_MOD_ASYNC_SINKS
+/// Number of asynchronous sinks which can be open at the same time
+#define DEBUG_MOD_ASYNC_SINKS 2
+#endif
+
+#ifndef DEBUG_MOD_ASYNC_BUFFER
+/// Ring buffer size per sink in bytes, must be a power of two
+#define DEBUG_MOD_ASYNC_BUFFER (256 * 1024)
+#endif
+
+#ifndef DEBUG_MOD_ASYNC_BATCH
+/// Preferred size and alignment of each write, must be a power of
+/// two not larger than DEBUG_MOD_ASYNC_BUFFER
+#define DEBUG_MOD_ASYNC_BATCH (64 * 1024)
+#endif
+
+#ifndef DEBUG_MOD_ASYNC_INTERVAL
+/// Maximum time in milliseconds before incomplete batches are written
+#define DEBUG_MOD_ASYNC_INTERVAL 200
+#endif
+
+
+
+/// State of one asynchronous sink
+struct async_sink {
+    /// Set while the slot is in use
+    char		used;
+    /// Set when the worker should write out everything and exit
+    char		closing;
+    /// Set when the ring buffer was written out by the crash handler
+    char		crashed;
+    /// Set once the worker has exited, later output is written directly
+    char		stopped;
+    /// Output file descriptor
+    int			fd;
+    /// Stream handed out to the user
+    FILE*		stream;
+    /// Background thread doing the actual writes
+    pthread_t		worker;
+    /// Signals the worker that a batch is ready or the sink is closing
+    sem_t		wakeup;
+    /// Total number of bytes ever added, only written by the producer
+    size_t		head;
+    /// Total number of bytes ever written out, only written by the worker
+    size_t		tail;
+    /// Number of bytes lost
+    unsigned long	dropped;
+    /// Ring buffer storage
+    char		ring[DEBUG_MOD_ASYNC_BUFFER];
+};
+
+
+/// Statically allocated sinks
+static struct async_sink sinks[DEBUG_MOD_ASYNC_SINKS];
+/// Set once the sinks are registered to be written out at exit
+static char exit_registered = 0;
+
+
+
+/// Write out all pending data, in chunks aligned to the batch size
+static void
+async_flush(struct async_sink* s)
+{
+    size_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    size_t tail = s->tail;
+
+    while (tail != head) {
+	size_t offset = tail & (DEBUG_MOD_ASYNC_BUFFER - 1);
+	// Stop at the next batch boundary, which never crosses the ring end
+	size_t chunk = DEBUG_MOD_ASYNC_BATCH - (tail & (DEBUG_MOD_ASYNC_BATCH - 1));
+
+	if (chunk > head - tail) chunk = head - tail;
+	if (debug_mod_write_all(s->fd, s->ring + offset, chunk)) {
+	    __atomic_fetch_add(&s->dropped, chunk, __ATOMIC_RELAXED);
+	}
+	tail += chunk;
+	__atomic_store_n(&s->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Write out the ring buffer and extra bytes from the crash handler
+static void
+async_crash_drain(void* ctx,
+		  const char* extra,
+		  size_t len)
+{
+    struct async_sink* s = ctx;
+
+    if (! __atomic_test_and_set(&s->crashed, __ATOMIC_ACQ_REL)) {
+	size_t head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+	size_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+
+	// The worker might still be running, so leave its state alone
+	while (tail != head) {
+	    size_t offset = tail & (DEBUG_MOD_ASYNC_BUFFER - 1);
+	    size_t chunk = DEBUG_MOD_ASYNC_BUFFER - offset;
+
+	    if (chunk > head - tail) chunk = head - tail;
+	    if (debug_mod_write_all(s->fd, s->ring + offset, chunk)) return;
+	    tail += chunk;
+	}
+    }
+    debug_mod_write_all(s->fd, extra, len);
+}
+#endif
+
+
+
+/// Worker thread main loop
+static void*
+async_worker(void* arg)
+{
+    struct async_sink* s = arg;
+    struct timespec deadline;
+
+    for (;;) {
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += DEBUG_MOD_ASYNC_INTERVAL * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+	// Woken up early for complete batches, otherwise flush periodically
+	while (sem_timedwait(&s->wakeup, &deadline) && errno == EINTR) ;
+
+	if (__atomic_load_n(&s->closing, __ATOMIC_ACQUIRE)) break;
+	async_flush(s);
+    }
+    async_flush(s);
+    return NULL;
+}
+
+
+
+/// Copy output into the ring buffer without ever blocking
+static ssize_t
+async_cookie_write(void* cookie,
+		   const char* buf,
+		   size_t size)
+{
+    struct async_sink* s = cookie;
+    size_t head = s->head;
+    size_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+    size_t offset = head & (DEBUG_MOD_ASYNC_BUFFER - 1);
+    size_t first = DEBUG_MOD_ASYNC_BUFFER - offset;
+
+    if (size > DEBUG_MOD_ASYNC_BUFFER - (head - tail)) {	//no space left
+	__atomic_fetch_add(&s->dropped, size, __ATOMIC_RELAXED);
+	return size;
+    }
+
+    if (first > size) first = size;
+    memcpy(s->ring + offset, buf, first);
+    memcpy(s->ring, buf + first, size - first);
+    __atomic_store_n(&s->head, head + size, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&s->stopped, __ATOMIC_ACQUIRE)) {	//no worker anymore
+	async_flush(s);
+	return size;
+    }
+    // Wake up the worker when a batch boundary is crossed
+    if ((head & (DEBUG_MOD_ASYNC_BATCH - 1)) + size >= DEBUG_MOD_ASYNC_BATCH) {
+	sem_post(&s->wakeup);
+    }
+    return size;
+}
+
+
+
+/// Stop the worker after it has written out everything
+static void
+async_stop(struct async_sink* s)
+{
+    if (s->stopped) return;
+    __atomic_store_n(&s->closing, 1, __ATOMIC_RELEASE);
+    sem_post(&s->wakeup);
+    pthread_join(s->worker, NULL);
+    __atomic_store_n(&s->stopped, 1, __ATOMIC_RELEASE);
+}
+
+
+
+/// Write out all open sinks when the program exits without fclose()
+static void
+async_exit(void)
+{
+    for (unsigned i = 0; i < DEBUG_MOD_ASYNC_SINKS; ++i) {
+	struct async_sink* s = sinks + i;
+
+	if (! __atomic_load_n(&s->used, __ATOMIC_ACQUIRE) || ! s->stream) continue;
+	// Move an incomplete line from the stream buffer to the ring
+	fflush(s->stream);
+	async_stop(s);
+	async_flush(s);
+    }
+}
+
+
+
+/// Stop the worker after writing out everything and release the sink
+static int
+async_cookie_close(void* cookie)
+{
+    struct async_sink* s = cookie;
+    int r;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    async_stop(s);
+    async_flush(s);
+    sem_destroy(&s->wakeup);
+
+    r = close(s->fd);
+    s->stream = NULL;
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return r;
+}
+
+
+
+FILE*
+debug_mod_async_open(int fd)
+{
+    struct async_sink* s = NULL;
+
+    if (fd < 0) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_ASYNC_SINKS; ++i) {
+	if (! __atomic_test_and_set(&sinks[i].used, __ATOMIC_ACQUIRE)) {
+	    s = sinks + i;
+	    break;
+	}
+    }
+    if (! s) return NULL;	//all sinks in use
+
+    s->closing = 0;
+    s->crashed = 0;
+    s->stopped = 0;
+    s->fd = fd;
+    s->head = s->tail = 0;
+    s->dropped = 0;
+    if (sem_init(&s->wakeup, 0, 0)) goto fail_sem;
+    if (pthread_create(&s->worker, NULL, async_worker, s)) goto fail_thread;
+
+    s->stream = debug_mod_cookie_open(s, async_cookie_write, async_cookie_close);
+    if (! s->stream) goto fail_stream;
+    // Hand over each line as soon as it is complete
+    setvbuf(s->stream, NULL, _IOLBF, BUFSIZ);
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(s->stream, async_crash_drain, s);
+#endif
+    if (! exit_registered) exit_registered = ! atexit(async_exit);
+    return s->stream;
+
+fail_stream:
+    __atomic_store_n(&s->closing, 1, __ATOMIC_RELEASE);
+    sem_post(&s->wakeup);
+    pthread_join(s->worker, NULL);
+fail_thread:
+    sem_destroy(&s->wakeup);
+fail_sem:
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+
+unsigned long
+debug_mod_async_dropped(FILE* stream)
+{
+    for (unsigned i = 0; i < DEBUG_MOD_ASYNC_SINKS; ++i) {
+	if (stream && sinks[i].stream == stream) {
+	    return __atomic_load_n(&sinks[i].dropped, __ATOMIC_RELAXED);
+	}
+    }
+    return 0;
+}
+#endif //DEBUG_MOD_ASYNC
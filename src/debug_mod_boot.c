@@ -0,0 +1,311 @@
+///@file
+///@brief	Boot configuration implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#include <debug_mod_control.h>
+
+#ifdef DEBUG_MOD_BOOT
+
+#include "debug_mod_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifndef DEBUG_MOD_BOOT_ENTRIES
+/// Maximum number of entries in a specification
+#define DEBUG_MOD_BOOT_ENTRIES 16
+#endif
+
+#ifndef DEBUG_MOD_BOOT_CHARS
+/// Maximum length of a specification in characters
+#define DEBUG_MOD_BOOT_CHARS 512
+#endif
+
+#ifndef DEBUG_MOD_BOOT_FILES
+/// Maximum number of distinct target files
+#define DEBUG_MOD_BOOT_FILES 4
+#endif
+
+/// Size of the hash table, leaving at least half of it empty
+#define SLOTS (2 * DEBUG_MOD_BOOT_ENTRIES)
+
+
+
+/// Parsed specification entry
+struct boot_entry {
+    /// Module identifier or prefix, not terminated for prefixes
+    const char*		pattern;
+    /// Target stream name, NULL for the default
+    const char*		target;
+    /// Number of characters to compare
+    unsigned short	len;
+    /// Set if the pattern is a prefix
+    char		prefix;
+    /// Set if matching modules should be disabled
+    char		disable;
+};
+
+/// Target file opened for the specification
+struct boot_file {
+    /// File name as given in the specification
+    char		path[DEBUG_MOD_BOOT_CHARS];
+    /// Opened stream, NULL if unused
+    FILE*		stream;
+};
+
+
+/// Copy of the specification, split into strings in place
+static char pool[DEBUG_MOD_BOOT_CHARS];
+/// Parsed entries
+static struct boot_entry entries[DEBUG_MOD_BOOT_ENTRIES];
+/// Number of valid entries
+static unsigned char entries_used = 0;
+/// Hash table of entry indices plus one, zero marks an empty slot
+static unsigned char slots[SLOTS];
+/// Distinct prefix lengths in descending order
+static unsigned short prefix_lens[DEBUG_MOD_BOOT_ENTRIES];
+/// Number of valid prefix lengths
+static unsigned char prefix_count = 0;
+/// Opened target files, kept open as long as the program runs
+static struct boot_file files[DEBUG_MOD_BOOT_FILES];
+/// Set once a specification was loaded or looked for
+static char loaded = 0;
+
+
+
+/// Hash table slot for the given number of characters
+static inline unsigned
+boot_hash(const char* s,
+	  unsigned len)
+{
+    return debug_mod_hash(s, len) % SLOTS;
+}
+
+
+
+/// Find an entry of the given kind matching the first len characters
+static const struct boot_entry*
+boot_find(const char* module,
+	  unsigned len,
+	  char prefix)
+{
+    for (unsigned h = boot_hash(module, len); slots[h]; h = (h + 1) % SLOTS) {
+	const struct boot_entry* e = entries + slots[h] - 1;
+
+	if (e->prefix == prefix && e->len == len
+	    && 0 == memcmp(e->pattern, module, len)) return e;
+    }
+    return NULL;
+}
+
+
+
+/// Add a parsed entry to the hash table, replacing an earlier identical pattern
+static void
+boot_insert(unsigned char index)
+{
+    const struct boot_entry* e = entries + index;
+    unsigned h, i;
+
+    for (h = boot_hash(e->pattern, e->len); slots[h]; h = (h + 1) % SLOTS) {
+	const struct boot_entry* o = entries + slots[h] - 1;
+
+	if (o->prefix == e->prefix && o->len == e->len
+	    && 0 == memcmp(o->pattern, e->pattern, e->len)) break;
+    }
+    slots[h] = index + 1;
+
+    if (! e->prefix) return;
+    // Keep distinct prefix lengths sorted, longest first
+    for (i = 0; i < prefix_count && prefix_lens[i] > e->len; ++i) ;
+    if (i < prefix_count && prefix_lens[i] == e->len) return;
+    memmove(prefix_lens + i + 1, prefix_lens + i, (prefix_count - i) * sizeof(*prefix_lens));
+    prefix_lens[i] = e->len;
+    ++prefix_count;
+}
+
+
+
+/// Check for a character separating entries
+static inline char
+boot_separator(char c)
+{
+    return c == ',' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+
+
+/// Discard the loaded specification
+static void
+boot_reset(void)
+{
+    loaded = 1;
+    entries_used = 0;
+    prefix_count = 0;
+    memset(slots, 0, sizeof(slots));
+}
+
+
+
+/// Split the specification in the pool into entries
+///
+///@return Number of entries parsed or negative if there are too many,
+///	   in which case none of them is kept
+static int
+boot_parse(void)
+{
+    char* p = pool;
+
+    while (*p) {
+	struct boot_entry* e;
+	char *token, *colon;
+
+	if (boot_separator(*p)) {
+	    ++p;
+	    continue;
+	}
+	if (*p == '#') {	//comment until end of line
+	    while (*p && *p != '\n') ++p;
+	    continue;
+	}
+
+	// Terminate the token in place
+	token = p;
+	while (*p && ! boot_separator(*p)) ++p;
+	if (*p) *p++ = '\0';
+
+	if (entries_used >= DEBUG_MOD_BOOT_ENTRIES) {
+	    boot_reset();
+	    return -1;
+	}
+	e = entries + entries_used;
+	e->disable = *token == '-';
+	if (e->disable) ++token;
+	colon = strchr(token, ':');
+	e->target = NULL;
+	if (colon) {
+	    *colon = '\0';
+	    if (colon[1]) e->target = colon + 1;
+	}
+	e->pattern = token;
+	e->len = strlen(token);
+	e->prefix = e->len && token[e->len - 1] == '*';
+	if (e->prefix) --e->len;
+
+	boot_insert(entries_used++);
+    }
+    return entries_used;
+}
+
+
+
+/// Resolve a target name to a stream, opening files on first use
+static FILE*
+boot_target(const char* target)
+{
+    struct boot_file* free_file = NULL;
+
+    if (! target || 0 == strcmp(target, "stderr")) return stderr;
+    if (0 == strcmp(target, "stdout")) return stdout;
+
+    for (unsigned i = 0; i < DEBUG_MOD_BOOT_FILES; ++i) {
+	if (! files[i].stream) {
+	    if (! free_file) free_file = files + i;
+	} else if (0 == strcmp(files[i].path, target)) return files[i].stream;
+    }
+    if (! free_file) return stderr;	//too many files
+
+    free_file->stream = fopen(target, "a");
+    if (! free_file->stream) return stderr;
+    strcpy(free_file->path, target);
+    return free_file->stream;
+}
+
+
+
+int
+debug_mod_boot(const char* spec)
+{
+    size_t len = spec ? strlen(spec) : 0;
+
+    boot_reset();
+    if (len >= sizeof(pool)) return -1;
+
+    memcpy(pool, spec, len);
+    pool[len] = '\0';
+    return boot_parse();
+}
+
+
+
+int
+debug_mod_boot_file(const char* path)
+{
+    FILE* f = path ? fopen(path, "r") : NULL;
+    size_t len;
+
+    boot_reset();
+    if (! f) return -1;
+
+    len = fread(pool, 1, sizeof(pool) - 1, f);
+    pool[len] = '\0';
+    if (! feof(f)) len = sizeof(pool);	//too long or read error
+    fclose(f);
+    if (len >= sizeof(pool)) return -1;
+
+    return boot_parse();
+}
+
+
+
+char
+debug_mod_boot_apply(debug_mod* dm)
+{
+    const struct boot_entry* e;
+    unsigned len;
+
+    if (! loaded) {		//first registration, consult environment
+	const char* spec = getenv("DEBUGMOD");
+
+	if (spec) debug_mod_boot(spec);
+	else debug_mod_boot_file(getenv("DEBUGMOD_FILE"));
+    }
+    if (! entries_used || ! dm->module) return 0;
+
+    len = strlen(dm->module);
+    e = boot_find(dm->module, len, 0);
+    for (unsigned i = 0; ! e && i < prefix_count; ++i) {
+	if (prefix_lens[i] <= len) e = boot_find(dm->module, prefix_lens[i], 1);
+    }
+    if (! e) return 0;
+
+    if (e->disable) {
+	dm->func = NULL;
+	dm->stream = stderr;
+    } else {
+	dm->func = debug_mod_default_func ? debug_mod_default_func : debug_mod_always;
+	dm->stream = boot_target(e->target);
+    }
+    return 1;
+}
+#endif //DEBUG_MOD_BOOT
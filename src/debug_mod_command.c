@@ -0,0 +1,309 @@
+///@file
+///@brief	Text command interpreter implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#include <debug_mod_control.h>
+
+#ifdef DEBUG_MOD_COMMAND
+
+#include "debug_mod_internal.h"
+
+#include <string.h>
+
+
+#ifndef DEBUG_MOD_COMMAND_BATCH
+/// Maximum number of commands in one batch
+#define DEBUG_MOD_COMMAND_BATCH 8
+#endif
+
+/// Size of the module index, leaving at least half of it empty
+#define SLOTS (2 * DEBUG_MOD_MAX)
+/// Maximum number of words in a command
+#define WORDS 2
+
+
+
+/// Parsed command, referring to the original text
+struct command {
+    /// Module identifier or prefix, not terminated
+    const char*		pattern;
+    /// Number of characters to compare, zero for all modules
+    unsigned short	len;
+    /// Set if the pattern is a prefix
+    char		prefix;
+    /// One of '+' (enable), '-' (disable) or 'l' (list)
+    char		action;
+    /// Stream to switch to, NULL to keep the current one
+    FILE*		stream;
+    /// Module resolved through the index, for exact patterns
+    debug_mod*		dm;
+};
+
+
+/// Hash table of module list indices plus one, zero marks an empty slot
+static debug_mod_index_t index_slots[SLOTS];
+/// Hash of each module identifier when the index was built
+static uint32_t index_hashes[DEBUG_MOD_MAX];
+
+
+
+/// Rebuild the index over all registered modules
+static void
+command_index(void)
+{
+    debug_mod_index_t size;
+    debug_mod *const *mods = debug_mod_registry(&size);
+
+    memset(index_slots, 0, sizeof(index_slots));
+    for (debug_mod_index_t i = 0; i < size; ++i) {
+	unsigned h;
+
+	if (! mods[i] || ! mods[i]->module) continue;	//released slot
+	index_hashes[i] = debug_mod_hash(mods[i]->module, strlen(mods[i]->module));
+	for (h = index_hashes[i] % SLOTS; index_slots[h]; h = (h + 1) % SLOTS) ;
+	index_slots[h] = i + 1;
+    }
+}
+
+
+
+/// Look up a module in the index
+///
+///@return Module configuration or NULL if the index has no match
+static debug_mod*
+command_lookup(const char* name,
+	       unsigned len)
+{
+    debug_mod_index_t size;
+    debug_mod *const *mods = debug_mod_registry(&size);
+    uint32_t hash = debug_mod_hash(name, len);
+
+    for (unsigned h = hash % SLOTS; index_slots[h]; h = (h + 1) % SLOTS) {
+	debug_mod_index_t i = index_slots[h] - 1;
+	debug_mod* dm = i < size ? mods[i] : NULL;
+
+	// Entries may be outdated, so verify the actual identifier
+	if (index_hashes[i] == hash && dm && dm->module
+	    && 0 == strncmp(dm->module, name, len) && ! dm->module[len]) return dm;
+    }
+    return NULL;
+}
+
+
+
+/// Find a module by its identifier, updating an outdated index once
+static debug_mod*
+command_find(const char* name,
+	     unsigned len)
+{
+    debug_mod* dm = command_lookup(name, len);
+
+    if (dm) return dm;
+    // Modules registered or released since the last build are missing
+    command_index();
+    return command_lookup(name, len);
+}
+
+
+
+/// Check whether a word equals the given keyword
+static inline char
+command_is(const char* word,
+	   unsigned len,
+	   const char* keyword)
+{
+    return len == strlen(keyword) && 0 == strncmp(word, keyword, len);
+}
+
+
+
+/// Report a syntax error
+///
+///@return Always negative
+static int
+command_error(FILE* out,
+	      const char* message,
+	      const char* word,
+	      unsigned len)
+{
+    if (out) fprintf(out, "error: %s: %.*s\n", message, (int) len, word);
+    return -1;
+}
+
+
+
+/// Parse a module pattern into the command
+///
+///@return Zero on success or negative on error
+static int
+command_pattern(struct command* c,
+		const char* word,
+		unsigned len,
+		FILE* out)
+{
+    c->pattern = word;
+    c->len = len;
+    c->prefix = len && word[len - 1] == '*';
+    c->dm = NULL;
+    if (c->prefix) --c->len;
+    if (command_is(word, len, "all")) {
+	c->prefix = 1;
+	c->len = 0;
+    }
+    if (! c->len && ! c->prefix) return command_error(out, "missing module", word, len);
+    if (c->prefix) return 0;
+
+    c->dm = command_find(word, len);
+    if (! c->dm) return command_error(out, "unknown module", word, len);
+    return 0;
+}
+
+
+
+/// Parse the words of one command
+///
+///@return Zero on success or negative on error
+static int
+command_parse(struct command* c,
+	      const char* word[],
+	      unsigned len[],
+	      unsigned words,
+	      FILE* out)
+{
+    const char* action;
+
+    c->stream = NULL;
+    if (command_is(word[0], len[0], "list")) {
+	c->action = 'l';
+	if (words == 1) return command_pattern(c, "all", 3, out);
+	return command_pattern(c, word[1], len[1], out);
+    }
+
+    if (words == 1) {		//[+-]module
+	c->action = word[0][0];
+	if (c->action != '+' && c->action != '-') {
+	    return command_error(out, "missing + or -", word[0], len[0]);
+	}
+	return command_pattern(c, word[0] + 1, len[0] - 1, out);
+    }
+
+    // module +[stream] or module -
+    action = word[1];
+    c->action = action[0];
+    if (c->action == '+' && len[1] > 1) {
+	if (command_is(action + 1, len[1] - 1, "stderr")) c->stream = stderr;
+	else if (command_is(action + 1, len[1] - 1, "stdout")) c->stream = stdout;
+	else return command_error(out, "unknown stream", action + 1, len[1] - 1);
+    } else if ((c->action != '+' && c->action != '-') || len[1] != 1) {
+	return command_error(out, "expected + or -", action, len[1]);
+    }
+    return command_pattern(c, word[0], len[0], out);
+}
+
+
+
+/// Carry out a command for one module
+static void
+command_apply(const struct command* c,
+	      debug_mod* dm,
+	      FILE* out)
+{
+    switch (c->action) {
+    case '+':
+	if (! dm->func) {
+	    dm->func = debug_mod_default_func ? debug_mod_default_func : debug_mod_always;
+	}
+	if (c->stream) dm->stream = c->stream;
+	break;
+
+    case '-':
+	dm->func = NULL;
+	break;
+
+    case 'l':
+	if (! out) break;
+	fprintf(out, "%s\t%c%s\n", dm->module, dm->func ? '+' : '-',
+		dm->stream == stderr ? "stderr" : dm->stream == stdout ? "stdout" : "");
+	break;
+    }
+}
+
+
+
+int
+debug_mod_command(const char* commands,
+		  FILE* out)
+{
+    struct command batch[DEBUG_MOD_COMMAND_BATCH];
+    unsigned count = 0;
+    const char* p = commands;
+    debug_mod_index_t size;
+    debug_mod *const *mods;
+
+    if (! p) return -1;
+
+    // Parse the whole batch first, so it is applied either completely or not at all
+    while (*p) {
+	const char* word[WORDS];
+	unsigned len[WORDS], words = 0;
+
+	for (;;) {
+	    while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+	    if (*p == '#') while (*p && *p != '\n') ++p;	//comment
+	    if (! *p || *p == ';' || *p == '\n') break;
+	    if (words == WORDS) {
+		const char* extra = p;
+
+		while (*p && *p != ';' && *p != '\n') ++p;
+		return command_error(out, "too many words", extra, p - extra);
+	    }
+	    word[words] = p;
+	    while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != ';' && *p != '\n') ++p;
+	    len[words] = p - word[words];
+	    ++words;
+	}
+	if (*p) ++p;		//skip separator
+	if (! words) continue;	//empty command
+
+	if (count == DEBUG_MOD_COMMAND_BATCH) {
+	    return command_error(out, "too many commands", word[0], len[0]);
+	}
+	if (command_parse(batch + count, word, len, words, out)) return -1;
+	++count;
+    }
+
+    mods = debug_mod_registry(&size);
+    for (unsigned n = 0; n < count; ++n) {
+	const struct command* c = batch + n;
+
+	if (c->dm) {		//resolved through the index
+	    command_apply(c, c->dm, out);
+	    continue;
+	}
+	for (debug_mod_index_t i = 0; i < size; ++i) {
+	    if (! mods[i] || ! mods[i]->module) continue;	//released slot
+	    if (0 == strncmp(mods[i]->module, c->pattern, c->len)) command_apply(c, mods[i], out);
+	}
+    }
+    return count;
+}
+#endif //DEBUG_MOD_COMMAND
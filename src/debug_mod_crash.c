@@ -0,0 +1,247 @@
+///@file
+///@brief	Crash drain implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for sigaction(), sigaltstack()
+
+#include <debug_mod_control.h>
+
+#ifdef DEBUG_MOD_CRASH
+
+#include "debug_mod_internal.h"
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#ifndef DEBUG_MOD_CRASH_SINKS
+/// Maximum number of library sinks known to the crash handler
+#define DEBUG_MOD_CRASH_SINKS 8
+#endif
+
+#ifndef DEBUG_MOD_CRASH_STACK
+/// Size of the alternate signal stack in bytes
+#define DEBUG_MOD_CRASH_STACK (64 * 1024)
+#endif
+
+
+
+/// Library sink with its drain function
+struct crash_sink {
+    /// Stream handed out to the user, NULL if unused
+    FILE*		stream;
+    /// Function to write out pending data
+    debug_mod_drain_f	drain;
+    /// Private data of the sink
+    void*		ctx;
+};
+
+
+/// Signals which are handled
+static const int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+/// Handlers installed before ours, same order as signals
+static struct sigaction previous[sizeof(signals) / sizeof(*signals)];
+/// Known library sinks
+static struct crash_sink sinks[DEBUG_MOD_CRASH_SINKS];
+/// Alternate stack for the signal handler
+static char stack[DEBUG_MOD_CRASH_STACK];
+/// Set once the handler is installed
+static char installed = 0;
+/// Set once the output was drained, to do it only once
+static char drained = 0;
+
+
+
+int
+debug_mod_crash_sink(FILE* stream,
+		     debug_mod_drain_f drain,
+		     void* ctx)
+{
+    for (unsigned i = 0; i < DEBUG_MOD_CRASH_SINKS; ++i) {
+	if (! sinks[i].stream) {
+	    sinks[i].drain = drain;
+	    sinks[i].ctx = ctx;
+	    // Publish the complete entry to the signal handler
+	    __atomic_store_n(&sinks[i].stream, stream, __ATOMIC_RELEASE);
+	    return 0;
+	}
+    }
+    return -1;
+}
+
+
+
+void
+debug_mod_crash_sink_remove(FILE* stream)
+{
+    for (unsigned i = 0; i < DEBUG_MOD_CRASH_SINKS; ++i) {
+	if (sinks[i].stream == stream) {
+	    __atomic_store_n(&sinks[i].stream, NULL, __ATOMIC_RELEASE);
+	}
+    }
+}
+
+
+
+/// Format the marker line without using stdio
+///
+///@return Length of the marker text
+static size_t
+crash_marker(char* buf,
+	     int sig)
+{
+    static const char text[] = "*** debug_mod: output drained on signal ";
+    char digits[12];
+    size_t len = sizeof(text) - 1, n = 0;
+
+    memcpy(buf, text, len);
+    do digits[n++] = '0' + sig % 10; while (sig /= 10);
+    while (n) buf[len++] = digits[--n];
+    memcpy(buf + len, " ***\n", 5);
+    return len + 5;
+}
+
+
+
+void
+debug_mod_crash_drain(FILE* stream,
+		      const char* extra,
+		      size_t len)
+{
+    const struct crash_sink* sink = NULL;
+    const char* pending = NULL;
+    size_t pending_len = 0;
+    int fd = -1;
+
+    for (unsigned i = 0; i < DEBUG_MOD_CRASH_SINKS; ++i) {
+	if (__atomic_load_n(&sinks[i].stream, __ATOMIC_ACQUIRE) == stream) {
+	    sink = sinks + i;
+	    break;
+	}
+    }
+
+#ifdef __GLIBC__
+    fd = stream->_fileno;
+    // Take over the stdio buffer contents, so they are not written twice,
+    // but only if they can be written at all
+    pending = stream->_IO_write_base;
+    if ((sink || fd >= 0) && pending && stream->_IO_write_ptr > pending) {
+	pending_len = stream->_IO_write_ptr - pending;
+	stream->_IO_write_ptr = stream->_IO_write_base;
+    }
+#endif
+
+    if (sink) {
+	sink->drain(sink->ctx, pending, pending_len);
+	sink->drain(sink->ctx, extra, len);
+	return;
+    }
+    if (fd < 0) return;	//neither a library sink nor a plain file stream
+    debug_mod_write_all(fd, pending, pending_len);
+    debug_mod_write_all(fd, extra, len);
+}
+
+
+
+/// Drain all distinct streams of the registered modules
+static void
+crash_drain(int sig)
+{
+    debug_mod_index_t size, done = 0;
+    debug_mod *const *mods = debug_mod_registry(&size);
+    FILE* seen[size ? size : 1];
+    char marker[64];
+    size_t marker_len = crash_marker(marker, sig);
+
+    for (debug_mod_index_t i = 0; i < size; ++i) {
+	FILE* stream;
+	debug_mod_index_t j;
+
+	if (! mods[i] || ! (stream = mods[i]->stream)) continue;
+	for (j = 0; j < done && seen[j] != stream; ++j) ;
+	if (j < done) continue;		//already drained
+	seen[done++] = stream;
+	debug_mod_crash_drain(stream, marker, marker_len);
+    }
+}
+
+
+
+/// Signal handler draining the output before passing on the signal
+static void
+crash_handler(int sig,
+	      siginfo_t* info,
+	      void* context)
+{
+    const struct sigaction* old = NULL;
+
+    if (! __atomic_test_and_set(&drained, __ATOMIC_ACQ_REL)) crash_drain(sig);
+
+    for (unsigned i = 0; i < sizeof(signals) / sizeof(*signals); ++i) {
+	if (signals[i] == sig) old = previous + i;
+    }
+    if (! old) return;
+
+    if (old->sa_flags & SA_SIGINFO) {
+	old->sa_sigaction(sig, info, context);
+    } else if (old->sa_handler == SIG_IGN) {
+	return;
+    } else if (old->sa_handler != SIG_DFL) {
+	old->sa_handler(sig);
+    } else {
+	// Restore the default action, taken when the handler returns
+	sigaction(sig, old, NULL);
+	raise(sig);
+    }
+}
+
+
+
+int
+debug_mod_crash_install(void)
+{
+    stack_t ss = {
+	.ss_sp		= stack,
+	.ss_size	= sizeof(stack),
+	.ss_flags	= 0,
+    };
+    stack_t old;
+    struct sigaction sa;
+
+    if (installed) return 0;	//never chain to ourselves
+    // Keep an alternate stack set up by the application or a runtime
+    if (sigaltstack(NULL, &old)) return -1;
+    if ((old.ss_flags & SS_DISABLE) && sigaltstack(&ss, NULL)) return -1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = crash_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+
+    for (unsigned i = 0; i < sizeof(signals) / sizeof(*signals); ++i) {
+	if (sigaction(signals[i], &sa, previous + i)) return -1;
+    }
+    installed = 1;
+    return 0;
+}
+#endif //DEBUG_MOD_CRASH
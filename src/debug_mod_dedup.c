@@ -0,0 +1,259 @@
+///@file
+///@brief	Duplicate suppressing sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie(), clock_gettime()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_DEDUP
+
+#include "debug_mod_internal.h"
+
+#include <string.h>
+
+
+#ifndef DEBUG_MOD_DEDUP_STREAMS
+/// Number of duplicate suppressing sinks which can be open at the same time
+#define DEBUG_MOD_DEDUP_STREAMS 4
+#endif
+
+#ifndef DEBUG_MOD_DEDUP_LINE
+/// Maximum length of a line to compare, longer lines are passed on
+#define DEBUG_MOD_DEDUP_LINE 256
+#endif
+
+#ifndef DEBUG_MOD_DEDUP_WINDOW
+/// Milliseconds after which a summary is written during a long repetition
+#define DEBUG_MOD_DEDUP_WINDOW 5000
+#endif
+
+
+
+/// State of one duplicate suppressing sink
+struct dedup_sink {
+    /// Set while the slot is in use
+    char		used;
+    /// Set while passing on the rest of an overlong line
+    char		overlong;
+    /// Set when the pending line was written out by the crash handler
+    char		crashed;
+    /// Stream receiving the output
+    FILE*		target;
+    /// Stream handed out to the user
+    FILE*		stream;
+    /// Number of bytes collected for the current line
+    size_t		len;
+    /// Length of the last line written, zero if none to compare
+    size_t		last_len;
+    /// Hash of the last line written
+    uint32_t		last_hash;
+    /// Number of suppressed repetitions of the last line
+    unsigned long	repeats;
+    /// Time of the first suppressed repetition
+    uint64_t		since;
+    /// Current line being collected
+    char		line[DEBUG_MOD_DEDUP_LINE];
+    /// Last line written, for comparison
+    char		last[DEBUG_MOD_DEDUP_LINE];
+};
+
+
+/// Statically allocated sinks
+static struct dedup_sink sinks[DEBUG_MOD_DEDUP_STREAMS];
+
+
+
+/// Write out the number of suppressed repetitions, if any
+static void
+dedup_summary(struct dedup_sink* s)
+{
+    if (! s->repeats) return;
+    fprintf(s->target, "last message repeated %lu times\n", s->repeats);
+    s->repeats = 0;
+}
+
+
+
+/// Pass on a complete line unless it repeats the last one
+static void
+dedup_line(struct dedup_sink* s)
+{
+    uint32_t h = debug_mod_hash(s->line, s->len);
+
+    if (s->len == s->last_len && h == s->last_hash
+	&& 0 == memcmp(s->line, s->last, s->len)) {
+	uint64_t now = debug_mod_now();
+
+	if (! s->repeats) s->since = now;
+	++s->repeats;
+	// Report long repetitions now and then
+	if (now - s->since >= DEBUG_MOD_DEDUP_WINDOW * 1000000ull) dedup_summary(s);
+	return;
+    }
+
+    dedup_summary(s);
+    fwrite(s->line, 1, s->len, s->target);
+    memcpy(s->last, s->line, s->len);
+    s->last_len = s->len;
+    s->last_hash = h;
+}
+
+
+
+/// Split the output into lines and filter them
+static ssize_t
+dedup_cookie_write(void* cookie,
+		   const char* buf,
+		   size_t size)
+{
+    struct dedup_sink* s = cookie;
+    const char* end = buf + size;
+
+    while (buf < end) {
+	const char* newline = memchr(buf, '\n', end - buf);
+	size_t chunk = newline ? (size_t) (newline + 1 - buf) : (size_t) (end - buf);
+
+	if (s->overlong) {
+	    fwrite(buf, 1, chunk, s->target);
+	    s->overlong = ! newline;
+	} else if (s->len + chunk > sizeof(s->line)) {	//too long to compare
+	    dedup_summary(s);
+	    fwrite(s->line, 1, s->len, s->target);
+	    fwrite(buf, 1, chunk, s->target);
+	    s->len = s->last_len = 0;
+	    s->overlong = ! newline;
+	} else {
+	    memcpy(s->line + s->len, buf, chunk);
+	    s->len += chunk;
+	    if (newline) {
+		dedup_line(s);
+		s->len = 0;
+	    }
+	}
+	buf += chunk;
+    }
+    return size;
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Format the summary line without using stdio
+///
+///@return Length of the summary text
+static size_t
+dedup_crash_summary(char* buf,
+		    unsigned long repeats)
+{
+    static const char text[] = "last message repeated ";
+    char digits[3 * sizeof(repeats)];
+    size_t len = sizeof(text) - 1, n = 0;
+
+    memcpy(buf, text, len);
+    do digits[n++] = '0' + repeats % 10; while (repeats /= 10);
+    while (n) buf[len++] = digits[--n];
+    memcpy(buf + len, " times\n", 7);
+    return len + 7;
+}
+
+
+
+/// Write out pending repetitions, the incomplete line and extra bytes
+/// from the crash handler
+static void
+dedup_crash_drain(void* ctx,
+		  const char* extra,
+		  size_t len)
+{
+    struct dedup_sink* s = ctx;
+
+    if (! __atomic_test_and_set(&s->crashed, __ATOMIC_ACQ_REL)) {
+	char summary[64];
+
+	// Keep the count of a storm which was still going on
+	if (s->repeats) {
+	    debug_mod_crash_drain(s->target, summary,
+				  dedup_crash_summary(summary, s->repeats));
+	}
+	debug_mod_crash_drain(s->target, s->line, s->len);
+    }
+    debug_mod_crash_drain(s->target, extra, len);
+}
+#endif
+
+
+
+/// Write out the summary and incomplete line, then release the sink
+static int
+dedup_cookie_close(void* cookie)
+{
+    struct dedup_sink* s = cookie;
+    int r = 0;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    dedup_summary(s);
+    fwrite(s->line, 1, s->len, s->target);
+    if (fflush(s->target)) r = EOF;
+
+    s->target = s->stream = NULL;
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return r;
+}
+
+
+
+FILE*
+debug_mod_dedup_open(FILE* target)
+{
+    struct dedup_sink* s = NULL;
+
+    if (! target) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_DEDUP_STREAMS; ++i) {
+	if (! __atomic_test_and_set(&sinks[i].used, __ATOMIC_ACQUIRE)) {
+	    s = sinks + i;
+	    break;
+	}
+    }
+    if (! s) return NULL;	//all sinks in use
+
+    s->target = target;
+    s->overlong = s->crashed = 0;
+    s->len = s->last_len = 0;
+    s->repeats = 0;
+    s->stream = debug_mod_cookie_open(s, dedup_cookie_write, dedup_cookie_close);
+    if (! s->stream) {
+	s->target = NULL;
+	__atomic_clear(&s->used, __ATOMIC_RELEASE);
+	return NULL;
+    }
+    // Pass on each line as soon as it is complete
+    setvbuf(s->stream, NULL, _IOLBF, BUFSIZ);
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(s->stream, dedup_crash_drain, s);
+#endif
+    return s->stream;
+}
+#endif //DEBUG_MOD_DEDUP
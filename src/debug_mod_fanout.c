@@ -0,0 +1,249 @@
+///@file
+///@brief	Fan-out sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_FANOUT
+
+#include "debug_mod_internal.h"
+
+
+#ifndef DEBUG_MOD_FANOUT_STREAMS
+/// Number of fan-out sinks which can be open at the same time
+#define DEBUG_MOD_FANOUT_STREAMS 4
+#endif
+
+#ifndef DEBUG_MOD_FANOUT_TARGETS
+/// Maximum number of target streams per fan-out sink
+#define DEBUG_MOD_FANOUT_TARGETS 4
+#endif
+
+#ifndef DEBUG_MOD_FANOUT_BUFFER
+/// Size of the line buffer, longer lines are passed on in pieces
+#define DEBUG_MOD_FANOUT_BUFFER 1024
+#endif
+
+
+
+/// Target stream of a fan-out sink
+struct fanout_target {
+    /// Stream receiving the output, NULL if unused
+    FILE*		stream;
+    /// Set while output is passed on to this target
+    char		enabled;
+};
+
+/// State of one fan-out sink
+struct fanout_sink {
+    /// Set while the slot is in use
+    char		used;
+    /// Stream handed out to the user
+    FILE*		stream;
+    /// Streams receiving the output
+    struct fanout_target targets[DEBUG_MOD_FANOUT_TARGETS];
+    /// Buffer for the returned stream, holding one formatted line
+    char		line[DEBUG_MOD_FANOUT_BUFFER];
+};
+
+
+/// Statically allocated sinks
+static struct fanout_sink sinks[DEBUG_MOD_FANOUT_STREAMS];
+
+
+
+/// Find the sink state for a stream
+static struct fanout_sink*
+fanout_find(FILE* stream)
+{
+    if (! stream) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_STREAMS; ++i) {
+	if (__atomic_load_n(&sinks[i].stream, __ATOMIC_ACQUIRE) == stream) return sinks + i;
+    }
+    return NULL;
+}
+
+
+
+/// Find the entry for a target stream within a sink
+static struct fanout_target*
+fanout_target(struct fanout_sink* s,
+	      FILE* target)
+{
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_TARGETS; ++i) {
+	if (s->targets[i].stream == target) return s->targets + i;
+    }
+    return NULL;
+}
+
+
+
+/// Pass on the formatted output to all enabled targets
+static ssize_t
+fanout_cookie_write(void* cookie,
+		    const char* buf,
+		    size_t size)
+{
+    struct fanout_sink* s = cookie;
+
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_TARGETS; ++i) {
+	struct fanout_target* t = s->targets + i;
+	FILE* target = __atomic_load_n(&t->stream, __ATOMIC_ACQUIRE);
+
+	// A failing target must not keep the others from getting output
+	if (target && __atomic_load_n(&t->enabled, __ATOMIC_RELAXED)) {
+	    fwrite(buf, 1, size, target);
+	}
+    }
+    return size;
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Write out all targets, then the extra bytes to each, from the crash handler
+static void
+fanout_crash_drain(void* ctx,
+		   const char* extra,
+		   size_t len)
+{
+    struct fanout_sink* s = ctx;
+
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_TARGETS; ++i) {
+	struct fanout_target* t = s->targets + i;
+	FILE* target = __atomic_load_n(&t->stream, __ATOMIC_ACQUIRE);
+
+	if (target && __atomic_load_n(&t->enabled, __ATOMIC_RELAXED)) {
+	    debug_mod_crash_drain(target, extra, len);
+	}
+    }
+}
+#endif
+
+
+
+/// Release the sink, leaving the targets open
+static int
+fanout_cookie_close(void* cookie)
+{
+    struct fanout_sink* s = cookie;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_TARGETS; ++i) {
+	s->targets[i].stream = NULL;
+    }
+    __atomic_store_n(&s->stream, NULL, __ATOMIC_RELEASE);
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+
+FILE*
+debug_mod_fanout_open(void)
+{
+    struct fanout_sink* s = NULL;
+    FILE* stream;
+
+    for (unsigned i = 0; i < DEBUG_MOD_FANOUT_STREAMS; ++i) {
+	if (! __atomic_test_and_set(&sinks[i].used, __ATOMIC_ACQUIRE)) {
+	    s = sinks + i;
+	    break;
+	}
+    }
+    if (! s) return NULL;	//all sinks in use
+
+    stream = debug_mod_cookie_open(s, fanout_cookie_write, fanout_cookie_close);
+    if (! stream) {
+	__atomic_clear(&s->used, __ATOMIC_RELEASE);
+	return NULL;
+    }
+    // Format each line once into the buffer, pass it on when complete
+    setvbuf(stream, s->line, _IOLBF, sizeof(s->line));
+    __atomic_store_n(&s->stream, stream, __ATOMIC_RELEASE);
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(stream, fanout_crash_drain, s);
+#endif
+    return stream;
+}
+
+
+
+int
+debug_mod_fanout_add(FILE* fanout,
+		     FILE* target)
+{
+    struct fanout_sink* s = fanout_find(fanout);
+    struct fanout_target* t;
+
+    if (! s || ! target || target == fanout) return -1;
+
+    flockfile(fanout);
+    t = fanout_target(s, target);
+    if (! t) t = fanout_target(s, NULL);	//first free entry
+    if (t) {
+	t->enabled = 1;
+	__atomic_store_n(&t->stream, target, __ATOMIC_RELEASE);
+    }
+    funlockfile(fanout);
+    return t ? 0 : -1;
+}
+
+
+
+void
+debug_mod_fanout_remove(FILE* fanout,
+			FILE* target)
+{
+    struct fanout_sink* s = fanout_find(fanout);
+    struct fanout_target* t;
+
+    if (! s || ! target) return;
+
+    // Pending output still goes to the target, nothing is written afterwards
+    fflush(fanout);
+    flockfile(fanout);
+    t = fanout_target(s, target);
+    if (t) __atomic_store_n(&t->stream, NULL, __ATOMIC_RELEASE);
+    funlockfile(fanout);
+}
+
+
+
+int
+debug_mod_fanout_enable(FILE* fanout,
+			FILE* target,
+			char enable)
+{
+    struct fanout_sink* s = fanout_find(fanout);
+    struct fanout_target* t = s && target ? fanout_target(s, target) : NULL;
+
+    if (! t) return -1;
+    __atomic_store_n(&t->enabled, enable, __ATOMIC_RELAXED);
+    return 0;
+}
+#endif //DEBUG_MOD_FANOUT
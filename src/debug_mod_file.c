@@ -0,0 +1,410 @@
+///@file
+///@brief	Per-module file sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie(), sigaction(), clock_gettime()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_FILE
+
+#include "debug_mod_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#ifndef DEBUG_MOD_FILE_SINKS
+/// Number of files which can be open at the same time
+#define DEBUG_MOD_FILE_SINKS 8
+#endif
+
+#ifndef DEBUG_MOD_FILE_BUFFER
+/// Buffer size per file in bytes
+#define DEBUG_MOD_FILE_BUFFER (64 * 1024)
+#endif
+
+#ifndef DEBUG_MOD_FILE_INTERVAL
+/// Maximum time in milliseconds before complete lines are written
+#define DEBUG_MOD_FILE_INTERVAL 1000
+#endif
+
+#ifndef DEBUG_MOD_FILE_PATH
+/// Maximum length of a file path including the terminator
+#define DEBUG_MOD_FILE_PATH 256
+#endif
+
+
+
+/// State of one cached file
+struct file_sink {
+    /// Set when the buffer was written out by the crash handler
+    char		crashed;
+    /// Append-only file descriptor
+    int			fd;
+    /// Reopen request count when the file was opened
+    unsigned		generation;
+    /// Stream shared by all modules writing to the file, NULL if unused
+    FILE*		stream;
+    /// Time of the last write to the file
+    uint64_t		written;
+    /// Order of the last selection, to find the least recently used file
+    unsigned long	selected;
+    /// Number of valid bytes in the buffer
+    size_t		len;
+    /// Path the file was opened with, for reopening
+    char		path[DEBUG_MOD_FILE_PATH];
+    /// Output not yet written to the file
+    char		buf[DEBUG_MOD_FILE_BUFFER];
+};
+
+
+/// Statically allocated file cache
+static struct file_sink sinks[DEBUG_MOD_FILE_SINKS];
+/// Protects the cache while files are selected, opened or evicted
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+/// Number of selections so far
+static unsigned long selections = 0;
+/// Number of reopen requests, incremented from the signal handler
+static unsigned generation = 0;
+/// Handler installed for SIGHUP before ours
+static struct sigaction previous;
+/// Set once the buffers are registered to be written out at exit
+static char exit_registered = 0;
+/// Set once the SIGHUP handler is installed
+static char installed = 0;
+
+
+
+/// Open a file for appending
+///
+///@return File descriptor or negative on error
+static int
+file_open_fd(const char* path)
+{
+    return open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+}
+
+
+
+/// Write out the buffer, caller must hold the stream lock
+static void
+file_flush(struct file_sink* s)
+{
+    if (s->len) debug_mod_write_all(s->fd, s->buf, s->len);
+    s->len = 0;
+    s->written = debug_mod_now();
+}
+
+
+
+/// Switch to a newly opened file if a reopen was requested
+///
+/// Caller must hold the stream lock.  If the file cannot be opened,
+/// the old one is kept.
+static void
+file_check_reopen(struct file_sink* s)
+{
+    unsigned current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    int fd;
+
+    if (s->generation == current) return;
+    s->generation = current;
+
+    file_flush(s);
+    fd = file_open_fd(s->path);
+    if (fd < 0) return;
+    close(s->fd);
+    s->fd = fd;
+}
+
+
+
+/// Collect output in the buffer, writing it out when full or too old
+static ssize_t
+file_cookie_write(void* cookie,
+		  const char* buf,
+		  size_t size)
+{
+    struct file_sink* s = cookie;
+
+    file_check_reopen(s);
+    if (s->len + size > sizeof(s->buf)) {
+	file_flush(s);
+	// Too large for the buffer anyway
+	if (size > sizeof(s->buf)) {
+	    if (debug_mod_write_all(s->fd, buf, size)) return -1;
+	    return size;
+	}
+    }
+    memcpy(s->buf + s->len, buf, size);
+    s->len += size;
+
+    // Hand over complete lines after a while, even if the buffer is not full
+    if (s->buf[s->len - 1] == '\n'
+	&& debug_mod_now() - s->written >= DEBUG_MOD_FILE_INTERVAL * 1000000ull) {
+	file_flush(s);
+    }
+    return size;
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Write out the buffer and extra bytes from the crash handler
+static void
+file_crash_drain(void* ctx,
+		 const char* extra,
+		 size_t len)
+{
+    struct file_sink* s = ctx;
+
+    if (! __atomic_test_and_set(&s->crashed, __ATOMIC_ACQ_REL)) {
+	if (debug_mod_write_all(s->fd, s->buf, s->len)) return;
+    }
+    debug_mod_write_all(s->fd, extra, len);
+}
+#endif
+
+
+
+/// Write out the buffer and close the file
+static int
+file_cookie_close(void* cookie)
+{
+    struct file_sink* s = cookie;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    file_flush(s);
+    s->stream = NULL;
+    return close(s->fd);
+}
+
+
+
+/// Write out all buffers when the program exits
+static void
+file_exit(void)
+{
+    debug_mod_file_flush();
+}
+
+
+
+/// Count the registered modules writing to a stream
+static unsigned
+file_users(FILE* stream)
+{
+    debug_mod_index_t size;
+    debug_mod *const *mods = debug_mod_registry(&size);
+    unsigned users = 0;
+
+    for (debug_mod_index_t i = 0; i < size; ++i) {
+	if (mods[i] && mods[i]->stream == stream) ++users;
+    }
+    return users;
+}
+
+
+
+/// Find the cached file for a path, opening it if necessary
+///
+/// Caller must hold the cache lock.  When the cache is full, the least
+/// recently selected file without any module writing to it is closed.
+///
+///@return Cache entry or NULL on error
+static struct file_sink*
+file_get(const char* path)
+{
+    struct file_sink* s = NULL;
+    int fd;
+
+    for (unsigned i = 0; i < DEBUG_MOD_FILE_SINKS; ++i) {
+	if (sinks[i].stream && 0 == strcmp(sinks[i].path, path)) {
+	    sinks[i].selected = ++selections;
+	    return sinks + i;
+	}
+    }
+
+    if (strlen(path) >= sizeof(s->path)) return NULL;
+    for (unsigned i = 0; i < DEBUG_MOD_FILE_SINKS; ++i) {
+	if (! sinks[i].stream) {
+	    s = sinks + i;
+	    break;
+	}
+	if (! file_users(sinks[i].stream) && (! s || sinks[i].selected < s->selected)) {
+	    s = sinks + i;
+	}
+    }
+    if (! s) return NULL;	//all files in use
+    if (s->stream) fclose(s->stream);
+
+    fd = file_open_fd(path);
+    if (fd < 0) return NULL;
+
+    strcpy(s->path, path);
+    s->fd = fd;
+    s->generation = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    s->crashed = 0;
+    s->len = 0;
+    s->written = debug_mod_now();
+    s->selected = ++selections;
+    s->stream = debug_mod_cookie_open(s, file_cookie_write, file_cookie_close);
+    if (! s->stream) {
+	close(fd);
+	return NULL;
+    }
+    // The sink does its own buffering, every write goes straight to it
+    setvbuf(s->stream, NULL, _IONBF, 0);
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(s->stream, file_crash_drain, s);
+#endif
+    if (! exit_registered) exit_registered = ! atexit(file_exit);
+    return s;
+}
+
+
+
+/// Derive the file name from a directory and the module identifier
+///
+///@return Zero on success, non-zero if the path is too long
+static int
+file_module_path(char* path,
+		 const char* dir,
+		 const char* module)
+{
+    int n = snprintf(path, DEBUG_MOD_FILE_PATH, "%s%s.log", dir, module);
+    char* p = path + strlen(dir);
+
+    if (n < 0 || n >= DEBUG_MOD_FILE_PATH) return -1;
+    // Identifiers like __FILE__ may contain directories
+    while ((p = strchr(p, '/'))) *p = '_';
+    return 0;
+}
+
+
+
+int
+debug_mod_file_select(const char* module,
+		      const char* path)
+{
+    debug_mod_index_t size;
+    debug_mod *const *mods;
+    size_t len = path ? strlen(path) : 0;
+    char per_module = len && path[len - 1] == '/';
+    int count = 0, failed = 0;
+
+    if (! len) return -1;
+
+    pthread_mutex_lock(&cache_lock);
+    mods = debug_mod_registry(&size);
+    for (debug_mod_index_t i = 0; i < size; ++i) {
+	char name[DEBUG_MOD_FILE_PATH];
+	struct file_sink* s;
+
+	if (! mods[i] || ! mods[i]->module) continue;	//released slot
+	if (module && 0 != strcmp(mods[i]->module, module)) continue;
+
+	if (per_module && file_module_path(name, path, mods[i]->module)) {
+	    failed = 1;
+	    continue;
+	}
+	s = file_get(per_module ? name : path);
+	if (! s) {
+	    failed = 1;
+	    continue;
+	}
+	mods[i]->stream = s->stream;
+	++count;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return failed ? -1 : count;
+}
+
+
+
+void
+debug_mod_file_flush(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for (unsigned i = 0; i < DEBUG_MOD_FILE_SINKS; ++i) {
+	struct file_sink* s = sinks + i;
+
+	if (! s->stream) continue;
+	flockfile(s->stream);
+	file_check_reopen(s);
+	file_flush(s);
+	funlockfile(s->stream);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+
+
+void
+debug_mod_file_reopen(void)
+{
+    // Only an atomic increment, so this is safe in signal handlers
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+}
+
+
+
+/// Request reopening, then pass on the signal to the previous handler
+static void
+file_sighup(int sig,
+	    siginfo_t* info,
+	    void* context)
+{
+    debug_mod_file_reopen();
+
+    if (previous.sa_flags & SA_SIGINFO) {
+	previous.sa_sigaction(sig, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+	previous.sa_handler(sig);
+    }
+}
+
+
+
+int
+debug_mod_file_sighup(void)
+{
+    struct sigaction sa;
+
+    if (installed) return 0;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_sigaction = file_sighup;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SIGHUP, &sa, &previous)) return -1;
+    installed = 1;
+    return 0;
+}
+#endif //DEBUG_MOD_FILE
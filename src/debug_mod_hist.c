@@ -0,0 +1,235 @@
+///@file
+///@brief	Latency histogram implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for clock_gettime()
+
+#include <debug_mod_control.h>
+#include <debug_mod_trace.h>
+
+#ifdef DEBUG_MOD_HIST
+
+#include "debug_mod_internal.h"
+
+#include <string.h>
+
+
+#ifndef DEBUG_MOD_HIST_SITES
+/// Number of distinct contexts which can be timed
+#define DEBUG_MOD_HIST_SITES 32
+#endif
+
+#ifndef DEBUG_MOD_HIST_PRECISION
+/// Number of bits to sub-divide each power of two, giving a relative
+/// bucket width of 2^-DEBUG_MOD_HIST_PRECISION
+#define DEBUG_MOD_HIST_PRECISION 3
+#endif
+
+/// Number of linear sub-buckets per power of two
+#define SUB_BUCKETS	(1u << DEBUG_MOD_HIST_PRECISION)
+/// Total number of buckets to cover the 64 bit value range
+#define BUCKETS		((64 - DEBUG_MOD_HIST_PRECISION + 1) * SUB_BUCKETS)
+
+
+
+/// Log-bucketed latency histogram for one context
+struct debug_mod_hist {
+    /// Module identifier
+    const char*		module;
+    /// Name of the timed scope
+    const char*		context;
+    /// Largest recorded value
+    uint64_t		max;
+    /// Sample count per bucket
+    uint32_t		counts[BUCKETS];
+};
+
+
+/// Statically allocated histograms
+static debug_mod_hist hists[DEBUG_MOD_HIST_SITES];
+/// Number of histograms in use, only grows
+static debug_mod_index_t hists_used = 0;
+/// Lock protecting the allocation of new histograms
+static char hists_lock = 0;
+
+
+
+/// Map a value to its bucket index
+static inline unsigned
+hist_bucket(uint64_t value)
+{
+    unsigned shift;
+
+    if (value < SUB_BUCKETS) return value;
+    shift = 63 - __builtin_clzll(value) - DEBUG_MOD_HIST_PRECISION;
+    return ((shift + 1) << DEBUG_MOD_HIST_PRECISION)
+	+ ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+
+
+/// Highest value which maps to the given bucket index
+static inline uint64_t
+hist_bucket_value(unsigned index)
+{
+    unsigned shift;
+
+    if (index < SUB_BUCKETS) return index;
+    shift = (index >> DEBUG_MOD_HIST_PRECISION) - 1;
+    return (((uint64_t) (index & (SUB_BUCKETS - 1)) | SUB_BUCKETS) << shift)
+	+ ((uint64_t) 1 << shift) - 1;
+}
+
+
+
+/// Find or allocate the histogram for a module and context
+static debug_mod_hist*
+hist_lookup(const char* module,
+	    const char* context)
+{
+    debug_mod_hist* h = NULL;
+    debug_mod_index_t i;
+
+    while (__atomic_test_and_set(&hists_lock, __ATOMIC_ACQUIRE)) ;
+    for (i = 0; i < hists_used; ++i) {
+	if ((hists[i].module == module
+	     || (module && hists[i].module && 0 == strcmp(hists[i].module, module)))
+	    && (hists[i].context == context
+		|| (context && hists[i].context
+		    && 0 == strcmp(hists[i].context, context)))) {
+	    h = hists + i;
+	    break;
+	}
+    }
+    if (! h && hists_used < DEBUG_MOD_HIST_SITES) {	//new entry
+	h = hists + hists_used;
+	h->module = module;
+	h->context = context;
+	__atomic_store_n(&hists_used, hists_used + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_clear(&hists_lock, __ATOMIC_RELEASE);
+    return h;
+}
+
+
+
+debug_mod_timer
+debug_mod_hist_begin(debug_mod_hist** site,
+		     const debug_mod* self,
+		     const char* context)
+{
+    debug_mod_timer timer = { .hist = NULL, .start = 0 };
+
+    if (! site) return timer;
+    if (! *site) *site = hist_lookup(self->module, context);
+
+    timer.hist = *site;
+    if (timer.hist) timer.start = debug_mod_now();
+    return timer;
+}
+
+
+
+void
+debug_mod_hist_end(const debug_mod_timer* timer)
+{
+    uint64_t elapsed = debug_mod_now() - timer->start;
+    debug_mod_hist* h = timer->hist;
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(h->counts + hist_bucket(elapsed), 1, __ATOMIC_RELAXED);
+    while (elapsed > max
+	   && ! __atomic_compare_exchange_n(&h->max, &max, elapsed, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+}
+
+
+
+/// Find the value below which the given fraction of samples lies,
+/// limited to the recorded maximum
+static uint64_t
+hist_percentile(const uint32_t counts[],
+		uint64_t total,
+		uint64_t max,
+		unsigned per_100000)	///< Requested percentile, scaled by 1000
+{
+    // Rank of the requested sample, rounded up
+    uint64_t rank = (total * per_100000 + 99999) / 100000;
+    uint64_t sum = 0;
+
+    if (! rank) rank = 1;
+    for (unsigned b = 0; b < BUCKETS; ++b) {
+	sum += counts[b];
+	if (sum >= rank) {
+	    uint64_t value = hist_bucket_value(b);
+	    return value < max ? value : max;
+	}
+    }
+    return 0;
+}
+
+
+
+debug_mod_index_t
+debug_mod_hist_dump(FILE* stream)
+{
+    debug_mod_index_t used = __atomic_load_n(&hists_used, __ATOMIC_ACQUIRE);
+    uint32_t counts[BUCKETS];
+
+    if (! stream) return 0;
+
+    fputs("module\tcontext\tcount\tp50\tp99\tp999\tmax\n", stream);
+    for (debug_mod_index_t i = 0; i < used; ++i) {
+	uint64_t max = __atomic_load_n(&hists[i].max, __ATOMIC_RELAXED);
+	uint64_t total = 0;
+
+	// Take a snapshot for consistent percentiles
+	for (unsigned b = 0; b < BUCKETS; ++b) {
+	    counts[b] = __atomic_load_n(hists[i].counts + b, __ATOMIC_RELAXED);
+	    total += counts[b];
+	}
+	fprintf(stream, "%s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+		hists[i].module, hists[i].context,
+		(unsigned long long) total,
+		(unsigned long long) hist_percentile(counts, total, max, 50000),
+		(unsigned long long) hist_percentile(counts, total, max, 99000),
+		(unsigned long long) hist_percentile(counts, total, max, 99900),
+		(unsigned long long) max);
+    }
+    return used;
+}
+
+
+
+void
+debug_mod_hist_reset(void)
+{
+    debug_mod_index_t used = __atomic_load_n(&hists_used, __ATOMIC_ACQUIRE);
+
+    for (debug_mod_index_t i = 0; i < used; ++i) {
+	for (unsigned b = 0; b < BUCKETS; ++b) {
+	    __atomic_store_n(hists[i].counts + b, 0, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&hists[i].max, 0, __ATOMIC_RELAXED);
+    }
+}
+#endif //DEBUG_MOD_HIST
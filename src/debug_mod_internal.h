@@ -0,0 +1,249 @@
+///@file
+///@brief	Helpers shared between the library implementation files
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#ifndef DEBUG_MOD_INTERNAL_H_
+#define DEBUG_MOD_INTERNAL_H_
+
+#include <debug_mod_control.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+#ifndef DEBUG_MOD_MAX
+/// Size of the array to track module configurations
+#define DEBUG_MOD_MAX 4
+#endif
+
+#if defined(DEBUG_MOD_CRASH) || defined(DEBUG_MOD_COMMAND) || defined(DEBUG_MOD_FILE)
+/// Direct registry access is needed by some optional features
+#define DEBUG_MOD_REGISTRY
+#endif
+
+
+/// FNV-1a hash over the given number of characters
+static inline uint32_t
+debug_mod_hash(const char* s,
+	       size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    while (len--) h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h;
+}
+
+
+///@name Hooks into the module registry
+///@{
+
+#ifdef DEBUG_MOD_REGISTRY
+///@brief Access the list of registered modules
+///
+/// Works like debug_mod_list(), but is available independent of the
+/// DEBUG_MOD_SAVE feature.  The size only covers slots used so far.
+///
+///@return Start of the address list, which may contain NULL values
+debug_mod *const * debug_mod_registry(
+    debug_mod_index_t *size		///< [out] Where to write the list size
+);
+#endif
+
+#ifdef DEBUG_MOD_BOOT
+///@brief Apply the boot configuration to a newly registered module
+///
+///@return Non-zero if a matching entry was found and applied
+char debug_mod_boot_apply(
+    debug_mod* dm			///< [in,out] Configuration structure
+);
+#endif
+
+///@}
+
+
+#ifdef DEBUG_MOD_CRASH
+///@name Crash drain support for library sinks
+///@{
+
+///@brief Async-signal-safe function to write out a sink's pending data
+///
+/// Called from the crash handler.  The first call writes out any data
+/// held by the sink itself, followed by the given extra bytes.  Later
+/// calls only write the extra bytes.
+typedef void (*debug_mod_drain_f)(
+    void* ctx,				///< [in] Private data of the sink
+    const char* extra,			///< [in] Additional bytes to write
+    size_t len				///< [in] Number of additional bytes
+);
+
+///@brief Announce a library sink to the crash handler
+///
+///@return Zero on success, non-zero if the table is full
+int debug_mod_crash_sink(
+    FILE* stream,			///< [in] Stream handed out to the user
+    debug_mod_drain_f drain,		///< [in] Drain function for the stream
+    void* ctx				///< [in] Private data passed to drain
+);
+
+///@brief Remove a library sink from the crash handler
+void debug_mod_crash_sink_remove(
+    FILE* stream			///< [in] Stream handed out to the user
+);
+
+///@brief Write out a stream's pending data, followed by extra bytes
+///
+/// Async-signal-safe, for sinks passing on their data to other
+/// streams.  Works for plain file streams and announced library sinks.
+void debug_mod_crash_drain(
+    FILE* stream,			///< [in] Stream to drain
+    const char* extra,			///< [in] Additional bytes to write
+    size_t len				///< [in] Number of additional bytes
+);
+
+///@}
+#endif //DEBUG_MOD_CRASH
+
+
+#ifdef _GNU_SOURCE
+// POSIX helpers, only available if the including file requests them
+
+#include <errno.h>
+#include <sys/types.h>	//for ssize_t
+#include <time.h>
+#include <unistd.h>
+
+
+/// Read the monotonic clock in nanoseconds
+static inline uint64_t
+debug_mod_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+
+
+/// Write a buffer completely, retrying after interruptions
+///
+/// Only uses async-signal-safe calls, so it also serves the crash
+/// handler.
+///
+///@return Zero on success, non-zero if the file descriptor failed
+static inline int
+debug_mod_write_all(int fd,
+		    const char* buf,
+		    size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, buf, size);
+
+	if (n < 0 && errno == EINTR) continue;
+	if (n <= 0) return -1;
+	buf += n;
+	size -= n;
+    }
+    return 0;
+}
+
+
+
+/// Write handler for a stream backed by library code
+typedef ssize_t (*debug_mod_write_f)(
+    void* cookie,			///< [in] Private data of the stream
+    const char* buf,			///< [in] Data to write
+    size_t size				///< [in] Number of bytes
+);
+
+/// Close handler for a stream backed by library code
+typedef int (*debug_mod_close_f)(
+    void* cookie			///< [in] Private data of the stream
+);
+
+
+/// Create a write-only stream calling the given handlers
+///
+/// Requires fopencookie() from the GNU C library or compatible.
+///
+///@return New stream or NULL on error
+static inline FILE*
+debug_mod_cookie_open(void* cookie,
+		      debug_mod_write_f write,
+		      debug_mod_close_f close)
+{
+#if defined(__GLIBC__) || defined(__linux__)
+    cookie_io_functions_t io = {
+	.read	= NULL,
+	.write	= write,
+	.seek	= NULL,
+	.close	= close,
+    };
+
+    return fopencookie(cookie, "w", io);
+#else
+    (void) cookie; (void) write; (void) close;
+    return NULL;
+#endif
+}
+
+#endif //_GNU_SOURCE
+
+
+///@name Compressed stream format
+///
+/// A compressed stream starts with the four magic bytes, followed by
+/// the maximum uncompressed block size.  Each block is preceded by
+/// its stored size, with DEBUG_MOD_LZ_RAW set if the block data is
+/// not compressed.  Otherwise it uses the LZ4 block format.  A block
+/// size of zero terminates the stream.  All numbers are 32 bit little
+/// endian.
+///
+///@{
+
+/// Identification at the start of a compressed stream
+#define DEBUG_MOD_LZ_MAGIC	"DMLZ"
+/// Flag for blocks stored without compression
+#define DEBUG_MOD_LZ_RAW	0x80000000u
+
+/// Encode a 32 bit little endian number
+static inline void
+debug_mod_lz_put32(unsigned char* p,
+		   uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/// Decode a 32 bit little endian number
+static inline uint32_t
+debug_mod_lz_get32(const unsigned char* p)
+{
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+///@}
+
+
+#endif //DEBUG_MOD_INTERNAL_H_
@@ -0,0 +1,192 @@
+///@file
+///@brief	Line assembly implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie()
+
+#include <debug_mod.h>
+
+#ifdef DEBUG_MOD_LINE
+
+#include "debug_mod_internal.h"
+
+#include <pthread.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <stdio_ext.h>
+#endif
+
+
+#ifndef DEBUG_MOD_LINE_THREADS
+/// Number of line buffers, threads beyond this write directly
+#define DEBUG_MOD_LINE_THREADS 16
+#endif
+
+#ifndef DEBUG_MOD_LINE_SIZE
+/// Size of each line buffer, longer lines are truncated
+#define DEBUG_MOD_LINE_SIZE 512
+#endif
+
+
+
+/// Line buffer owned by one thread at a time
+struct line_slot {
+    /// Set while a thread owns the slot
+    char		used;
+    /// Set while a line is being assembled, to catch nested output
+    char		busy;
+    /// Number of valid bytes in the buffer
+    size_t		len;
+    /// Stream appending to the buffer, kept open for the next owner
+    FILE*		stream;
+    /// Copy of the module configuration writing to the buffer
+    debug_mod		line;
+    /// Stream which receives the completed line
+    FILE*		target;
+    /// Assembled line
+    char		buf[DEBUG_MOD_LINE_SIZE];
+};
+
+
+/// Arena of line buffers
+static struct line_slot slots[DEBUG_MOD_LINE_THREADS];
+/// Line buffer of the calling thread, NULL if none claimed yet
+static __thread struct line_slot* current = NULL;
+/// Set if the arena was exhausted for the calling thread
+static __thread char exhausted = 0;
+/// Key to release a thread's line buffer when it exits
+static pthread_key_t release_key;
+/// Make sure the key is created only once
+static pthread_once_t release_once = PTHREAD_ONCE_INIT;
+
+
+
+/// Append to the line buffer, silently dropping what does not fit
+static ssize_t
+line_cookie_write(void* cookie,
+		  const char* buf,
+		  size_t size)
+{
+    struct line_slot* s = cookie;
+    size_t n = sizeof(s->buf) - s->len;
+
+    if (n > size) n = size;
+    memcpy(s->buf + s->len, buf, n);
+    s->len += n;
+    return size;
+}
+
+
+
+/// Give back the line buffer of an exiting thread
+static void
+line_release(void* slot)
+{
+    struct line_slot* s = slot;
+
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+}
+
+
+
+/// Create the key for releasing line buffers
+static void
+line_key_create(void)
+{
+    pthread_key_create(&release_key, line_release);
+}
+
+
+
+/// Claim a line buffer from the arena for the calling thread
+static struct line_slot*
+line_claim(void)
+{
+    pthread_once(&release_once, line_key_create);
+
+    for (unsigned i = 0; i < DEBUG_MOD_LINE_THREADS; ++i) {
+	struct line_slot* s = slots + i;
+
+	if (__atomic_test_and_set(&s->used, __ATOMIC_ACQUIRE)) continue;
+	if (! s->stream) {	//first use of this slot
+	    s->stream = debug_mod_cookie_open(s, line_cookie_write, NULL);
+	    if (! s->stream) {
+		__atomic_clear(&s->used, __ATOMIC_RELEASE);
+		return NULL;
+	    }
+	    // Only one thread at a time uses the stream, the buffer is ours
+	    setvbuf(s->stream, NULL, _IONBF, 0);
+#ifdef __GLIBC__
+	    __fsetlocking(s->stream, FSETLOCKING_BYCALLER);
+#endif
+	}
+	pthread_setspecific(release_key, s);
+	return s;
+    }
+    return NULL;
+}
+
+
+
+debug_mod*
+debug_mod_line_begin(debug_mod* restrict self,
+		     const char* restrict context)
+{
+    struct line_slot* s = current;
+
+    if (! debug_mod_enabled(self)) return NULL;
+
+    if (! s && ! exhausted) {
+	s = current = line_claim();
+	exhausted = ! s;
+    }
+    if (! s || s->busy) {	//write directly without a line buffer
+	return self->func(self, context) ? self : NULL;
+    }
+
+    s->busy = 1;
+    s->len = 0;
+    s->target = self->stream;
+    s->line = *self;
+    s->line.stream = s->stream;
+    if (s->line.func(&s->line, context)) return &s->line;
+
+    s->busy = 0;
+    return NULL;
+}
+
+
+
+void
+debug_mod_line_end(debug_mod* line)
+{
+    struct line_slot* s = current;
+
+    if (! s || line != &s->line) return;	//written directly
+
+    fflush(s->stream);
+    // Keep the line terminated even if it was truncated
+    if (s->len == sizeof(s->buf)) s->buf[s->len - 1] = '\n';
+    fwrite(s->buf, 1, s->len, s->target);
+    s->busy = 0;
+}
+#endif //DEBUG_MOD_LINE
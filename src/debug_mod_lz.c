@@ -0,0 +1,296 @@
+///@file
+///@brief	Compressing sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie(), clock_gettime()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_LZ
+
+#include "debug_mod_internal.h"
+
+#include <string.h>
+
+
+#ifndef DEBUG_MOD_LZ_STREAMS
+/// Number of compressing sinks which can be open at the same time
+#define DEBUG_MOD_LZ_STREAMS 2
+#endif
+
+#ifndef DEBUG_MOD_LZ_BLOCK
+/// Uncompressed block size in bytes, at most 64 KiB
+#define DEBUG_MOD_LZ_BLOCK (64 * 1024)
+#endif
+
+/// Number of bits used to index the match finder table
+#define HASH_BITS	12
+/// Minimum length of a match
+#define MIN_MATCH	4
+/// Matches must start this many bytes before the block end
+#define MF_LIMIT	12
+/// Number of bytes at the block end which are always literals
+#define LAST_LITERALS	5
+/// Largest compressed size of a block in the worst case
+#define BLOCK_BOUND	(DEBUG_MOD_LZ_BLOCK + DEBUG_MOD_LZ_BLOCK / 255 + 16)
+
+
+
+/// State of one compressing sink
+struct lz_sink {
+    /// Set while the slot is in use
+    char		used;
+    /// Stream receiving the compressed data
+    FILE*		target;
+    /// Stream handed out to the user
+    FILE*		stream;
+    /// Recent positions for each hashed four-byte sequence
+    uint16_t		table[1u << HASH_BITS];
+    /// Buffer for the returned stream, collecting one block
+    char		block[DEBUG_MOD_LZ_BLOCK];
+    /// Block header and compressed data
+    unsigned char	out[4 + BLOCK_BOUND];
+};
+
+
+/// Statically allocated sinks
+static struct lz_sink sinks[DEBUG_MOD_LZ_STREAMS];
+
+
+
+/// Read four bytes for comparison, regardless of alignment
+static inline uint32_t
+lz_read32(const unsigned char* p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+
+/// Hash a four-byte sequence to a table index
+static inline unsigned
+lz_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+
+/// Encode a length exceeding the token field
+static inline unsigned char*
+lz_put_length(unsigned char* dst,
+	      size_t len)
+{
+    for (; len >= 255; len -= 255) *dst++ = 255;
+    *dst++ = len;
+    return dst;
+}
+
+
+
+/// Encode a sequence of literals and an optional match
+static inline unsigned char*
+lz_put_sequence(unsigned char* dst,
+		const unsigned char* literals,
+		size_t lit_len,
+		size_t offset,		///< Zero for the final literals
+		size_t match_len)
+{
+    unsigned char* token = dst++;
+
+    *token = (lit_len < 15 ? lit_len : 15) << 4;
+    if (lit_len >= 15) dst = lz_put_length(dst, lit_len - 15);
+    memcpy(dst, literals, lit_len);
+    dst += lit_len;
+
+    if (! offset) return dst;
+    *dst++ = offset;
+    *dst++ = offset >> 8;
+    match_len -= MIN_MATCH;
+    *token |= match_len < 15 ? match_len : 15;
+    if (match_len >= 15) dst = lz_put_length(dst, match_len - 15);
+    return dst;
+}
+
+
+
+/// Compress one block using a greedy single-probe match finder
+///
+///@return Size of the compressed data
+static size_t
+lz_compress(uint16_t table[],
+	    const unsigned char* src,
+	    size_t size,
+	    unsigned char* dst)
+{
+    const unsigned char* const start = dst;
+    size_t limit = size > MF_LIMIT ? size - MF_LIMIT : 0;
+    size_t anchor = 0, pos = 0;
+
+    memset(table, 0, sizeof(uint16_t) << HASH_BITS);
+    while (pos < limit) {
+	uint32_t sequence = lz_read32(src + pos);
+	unsigned h = lz_hash(sequence);
+	size_t ref = table[h];
+	size_t len = MIN_MATCH;
+
+	table[h] = pos;
+	if (ref >= pos || lz_read32(src + ref) != sequence) {
+	    ++pos;
+	    continue;
+	}
+
+	while (pos + len < size - LAST_LITERALS && src[ref + len] == src[pos + len]) ++len;
+	dst = lz_put_sequence(dst, src + anchor, pos - anchor, pos - ref, len);
+	pos += len;
+	anchor = pos;
+    }
+    dst = lz_put_sequence(dst, src + anchor, size - anchor, 0, 0);
+    return dst - start;
+}
+
+
+
+/// Compress and pass on complete blocks
+static ssize_t
+lz_cookie_write(void* cookie,
+		const char* buf,
+		size_t size)
+{
+    struct lz_sink* s = cookie;
+    size_t done = 0;
+
+    while (done < size) {
+	size_t chunk = size - done;
+	size_t packed;
+
+	if (chunk > DEBUG_MOD_LZ_BLOCK) chunk = DEBUG_MOD_LZ_BLOCK;
+	packed = lz_compress(s->table, (const unsigned char*) buf + done, chunk, s->out + 4);
+	if (packed < chunk) {
+	    debug_mod_lz_put32(s->out, packed);
+	} else {			//store incompressible data as is
+	    packed = chunk;
+	    memcpy(s->out + 4, buf + done, chunk);
+	    debug_mod_lz_put32(s->out, chunk | DEBUG_MOD_LZ_RAW);
+	}
+
+	if (fwrite(s->out, 4 + packed, 1, s->target) != 1) break;
+	done += chunk;
+    }
+    fflush(s->target);
+
+    return done ? (ssize_t) done : -1;
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Write out data as uncompressed blocks from the crash handler
+///
+/// The compressor state may be in use by the interrupted thread, so
+/// only a local block header is used.
+static void
+lz_crash_drain(void* ctx,
+	       const char* extra,
+	       size_t len)
+{
+    struct lz_sink* s = ctx;
+
+    while (len) {
+	size_t chunk = len > DEBUG_MOD_LZ_BLOCK ? DEBUG_MOD_LZ_BLOCK : len;
+	unsigned char header[4];
+
+	debug_mod_lz_put32(header, chunk | DEBUG_MOD_LZ_RAW);
+	debug_mod_crash_drain(s->target, (const char*) header, sizeof(header));
+	debug_mod_crash_drain(s->target, extra, chunk);
+	extra += chunk;
+	len -= chunk;
+    }
+}
+#endif
+
+
+
+/// Terminate the compressed stream and release the sink
+static int
+lz_cookie_close(void* cookie)
+{
+    struct lz_sink* s = cookie;
+    unsigned char end[4];
+    int r = 0;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    debug_mod_lz_put32(end, 0);
+    if (fwrite(end, sizeof(end), 1, s->target) != 1) r = EOF;
+    if (fflush(s->target)) r = EOF;
+
+    s->target = NULL;
+    s->stream = NULL;
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return r;
+}
+
+
+
+FILE*
+debug_mod_lz_open(FILE* target)
+{
+    struct lz_sink* s = NULL;
+    unsigned char header[8];
+    FILE* stream;
+
+    if (! target) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_LZ_STREAMS; ++i) {
+	if (! __atomic_test_and_set(&sinks[i].used, __ATOMIC_ACQUIRE)) {
+	    s = sinks + i;
+	    break;
+	}
+    }
+    if (! s) return NULL;	//all sinks in use
+
+    memcpy(header, DEBUG_MOD_LZ_MAGIC, 4);
+    debug_mod_lz_put32(header + 4, DEBUG_MOD_LZ_BLOCK);
+    if (fwrite(header, sizeof(header), 1, target) != 1) goto fail;
+
+    s->target = target;
+    stream = debug_mod_cookie_open(s, lz_cookie_write, lz_cookie_close);
+    if (! stream) goto fail;
+    // Collect whole blocks in the stream buffer
+    setvbuf(stream, s->block, _IOFBF, sizeof(s->block));
+    s->stream = stream;
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(stream, lz_crash_drain, s);
+#endif
+    return stream;
+
+fail:
+    s->target = NULL;
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return NULL;
+}
+#endif //DEBUG_MOD_LZ
@@ -0,0 +1,376 @@
+///@file
+///@brief	Backpressure sink implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for fopencookie(), poll()
+
+#include <debug_mod_sink.h>
+
+#ifdef DEBUG_MOD_PIPE
+
+#include "debug_mod_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#ifndef DEBUG_MOD_PIPE_STREAMS
+/// Number of backpressure sinks which can be open at the same time
+#define DEBUG_MOD_PIPE_STREAMS 4
+#endif
+
+#ifndef DEBUG_MOD_PIPE_BUFFER
+/// Size of the buffer holding output the file descriptor did not accept
+#define DEBUG_MOD_PIPE_BUFFER (64 * 1024)
+#endif
+
+#ifndef DEBUG_MOD_PIPE_LINGER
+/// Milliseconds to wait for the consumer when closing the stream
+#define DEBUG_MOD_PIPE_LINGER 1000
+#endif
+
+
+
+/// State of one backpressure sink
+struct pipe_sink {
+    /// Set while the slot is in use
+    char		used;
+    /// Set while the first buffered line is partially written
+    char		started;
+    /// Set when the buffer was written out by the crash handler
+    char		crashed;
+    /// Selected behaviour when the buffer is full
+    debug_mod_pipe_policy policy;
+    /// Non-blocking file descriptor to write to
+    int			fd;
+    /// File status flags before switching to non-blocking mode
+    int			flags;
+    /// Stream handed out to the user
+    FILE*		stream;
+    /// Lines dropped since the last report
+    unsigned long	lines;
+    /// Bytes dropped since the last report
+    unsigned long	bytes;
+    /// Total bytes dropped
+    unsigned long	dropped;
+    /// Number of valid bytes in the buffer
+    size_t		len;
+    /// Output not yet accepted by the file descriptor
+    char		buf[DEBUG_MOD_PIPE_BUFFER];
+};
+
+
+/// Statically allocated sinks
+static struct pipe_sink sinks[DEBUG_MOD_PIPE_STREAMS];
+
+
+
+/// Find the sink state for a stream
+static struct pipe_sink*
+pipe_find(FILE* stream)
+{
+    if (! stream) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_PIPE_STREAMS; ++i) {
+	if (__atomic_load_n(&sinks[i].stream, __ATOMIC_ACQUIRE) == stream) return sinks + i;
+    }
+    return NULL;
+}
+
+
+
+/// Count the complete lines in a piece of output
+static unsigned long
+pipe_count_lines(const char* buf,
+		 size_t len)
+{
+    unsigned long lines = 0;
+    const char* end = buf + len;
+
+    while ((buf = memchr(buf, '\n', end - buf))) {
+	++lines;
+	++buf;
+    }
+    return lines;
+}
+
+
+
+/// Account for output which was dropped
+static void
+pipe_drop(struct pipe_sink* s,
+	  const char* buf,
+	  size_t len)
+{
+    unsigned long lines = pipe_count_lines(buf, len);
+
+    s->lines += lines ? lines : 1;
+    s->bytes += len;
+    __atomic_fetch_add(&s->dropped, len, __ATOMIC_RELAXED);
+}
+
+
+
+/// Wait until the file descriptor accepts more data
+///
+///@return Zero if writable, non-zero on timeout or error
+static int
+pipe_wait(struct pipe_sink* s,
+	  int timeout)
+{
+    struct pollfd p = { .fd = s->fd, .events = POLLOUT, .revents = 0 };
+
+    return poll(&p, 1, timeout) != 1;
+}
+
+
+
+/// Write out as much of the buffer as the file descriptor accepts
+///
+/// Once the buffer is empty, any drops are reported in-band.
+static void
+pipe_flush(struct pipe_sink* s,
+	   char block)
+{
+    for (;;) {
+	ssize_t n;
+
+	if (! s->len) {		//consumer caught up
+	    if (! s->lines || s->started) return;
+	    s->len = snprintf(s->buf, sizeof(s->buf),
+			      "*** debug_mod: dropped %lu lines (%lu bytes) ***\n",
+			      s->lines, s->bytes);
+	    s->lines = s->bytes = 0;
+	}
+
+	n = write(s->fd, s->buf, s->len);
+	if (n > 0) {
+	    s->started = s->buf[n - 1] != '\n';
+	    s->len -= n;
+	    memmove(s->buf, s->buf + n, s->len);
+	} else if (n < 0 && errno == EINTR) {
+	    continue;
+	} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	    if (! block || pipe_wait(s, -1)) return;
+	} else {		//consumer is gone
+	    pipe_drop(s, s->buf, s->len);
+	    s->len = 0;
+	    s->started = 0;
+	    s->lines = s->bytes = 0;	//nobody to report to
+	    return;
+	}
+    }
+}
+
+
+
+/// Drop whole lines after the partially written one until there is room
+static void
+pipe_drop_oldest(struct pipe_sink* s,
+		 size_t room)
+{
+    size_t keep = 0, end;
+    char* newline;
+
+    if (room > sizeof(s->buf)) room = sizeof(s->buf);
+    if (s->started) {		//the line in progress must be completed
+	newline = memchr(s->buf, '\n', s->len);
+	keep = newline ? (size_t) (newline + 1 - s->buf) : s->len;
+    }
+
+    // Find the first line boundary leaving enough room
+    for (end = keep; end < s->len && s->len - (end - keep) > sizeof(s->buf) - room; ) {
+	newline = memchr(s->buf + end, '\n', s->len - end);
+	end = newline ? (size_t) (newline + 1 - s->buf) : s->len;
+    }
+    if (end == keep) return;
+
+    pipe_drop(s, s->buf + keep, end - keep);
+    memmove(s->buf + keep, s->buf + end, s->len - end);
+    s->len -= end - keep;
+}
+
+
+
+/// Buffer the output and write as much as the policy allows
+static ssize_t
+pipe_cookie_write(void* cookie,
+		  const char* buf,
+		  size_t size)
+{
+    struct pipe_sink* s = cookie;
+    char block = s->policy == DEBUG_MOD_PIPE_BLOCK;
+    size_t done = 0;
+
+    pipe_flush(s, block);
+    while (done < size) {
+	size_t chunk = size - done, room = sizeof(s->buf) - s->len;
+
+	if (chunk > room && s->policy == DEBUG_MOD_PIPE_DROP_OLDEST) {
+	    pipe_drop_oldest(s, chunk);
+	    room = sizeof(s->buf) - s->len;
+	}
+	if (chunk > room) {
+	    if (! block) {	//drop the newest output
+		pipe_drop(s, buf + done, size - done);
+		break;
+	    }
+	    if (! room) return done ? (ssize_t) done : -1;	//waiting failed
+	    chunk = room;
+	}
+
+	memcpy(s->buf + s->len, buf + done, chunk);
+	s->len += chunk;
+	done += chunk;
+	pipe_flush(s, block);
+    }
+    return size;
+}
+
+
+
+#ifdef DEBUG_MOD_CRASH
+/// Write out the buffer and extra bytes from the crash handler
+static void
+pipe_crash_drain(void* ctx,
+		 const char* extra,
+		 size_t len)
+{
+    struct pipe_sink* s = ctx;
+    const char* data[2] = { extra, NULL };
+    size_t size[2] = { len, 0 };
+
+    if (! __atomic_test_and_set(&s->crashed, __ATOMIC_ACQ_REL)) {
+	data[1] = data[0];
+	size[1] = size[0];
+	data[0] = s->buf;
+	size[0] = s->len;
+    }
+    // Best effort, the file descriptor does not block
+    for (unsigned i = 0; i < 2; ++i) {
+	while (size[i]) {
+	    ssize_t n = write(s->fd, data[i], size[i]);
+
+	    if (n <= 0) return;
+	    data[i] += n;
+	    size[i] -= n;
+	}
+    }
+}
+#endif
+
+
+
+/// Write out what the consumer takes within a while and release the sink
+static int
+pipe_cookie_close(void* cookie)
+{
+    struct pipe_sink* s = cookie;
+    int r;
+
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink_remove(s->stream);
+#endif
+    do pipe_flush(s, 0);
+    while (s->len && ! pipe_wait(s, DEBUG_MOD_PIPE_LINGER));
+
+    // The file description may be shared through dup(), leave it as found
+    if (! (s->flags & O_NONBLOCK)) fcntl(s->fd, F_SETFL, s->flags);
+    r = close(s->fd);
+    __atomic_store_n(&s->stream, NULL, __ATOMIC_RELEASE);
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return r;
+}
+
+
+
+FILE*
+debug_mod_pipe_open(int fd,
+		    debug_mod_pipe_policy policy)
+{
+    struct pipe_sink* s = NULL;
+    FILE* stream;
+    int flags = fd < 0 ? -1 : fcntl(fd, F_GETFL);
+
+    if (flags == -1) return NULL;
+
+    for (unsigned i = 0; i < DEBUG_MOD_PIPE_STREAMS; ++i) {
+	if (! __atomic_test_and_set(&sinks[i].used, __ATOMIC_ACQUIRE)) {
+	    s = sinks + i;
+	    break;
+	}
+    }
+    if (! s) return NULL;	//all sinks in use
+
+    // Blocking is emulated with poll(), so the descriptor never blocks
+    if (! (flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK)) goto fail;
+
+    s->fd = fd;
+    s->flags = flags;
+    s->policy = policy;
+    s->started = s->crashed = 0;
+    s->lines = s->bytes = s->dropped = 0;
+    s->len = 0;
+    stream = debug_mod_cookie_open(s, pipe_cookie_write, pipe_cookie_close);
+    if (! stream) goto fail;
+    // Hand over each line as soon as it is complete
+    setvbuf(stream, NULL, _IOLBF, BUFSIZ);
+    __atomic_store_n(&s->stream, stream, __ATOMIC_RELEASE);
+#ifdef DEBUG_MOD_CRASH
+    debug_mod_crash_sink(stream, pipe_crash_drain, s);
+#endif
+    return stream;
+
+fail:
+    if (! (flags & O_NONBLOCK)) fcntl(fd, F_SETFL, flags);
+    __atomic_clear(&s->used, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+
+int
+debug_mod_pipe_set_policy(FILE* stream,
+			  debug_mod_pipe_policy policy)
+{
+    struct pipe_sink* s = pipe_find(stream);
+
+    if (! s) return -1;
+    flockfile(stream);
+    s->policy = policy;
+    funlockfile(stream);
+    return 0;
+}
+
+
+
+unsigned long
+debug_mod_pipe_dropped(FILE* stream)
+{
+    struct pipe_sink* s = pipe_find(stream);
+
+    return s ? __atomic_load_n(&s->dropped, __ATOMIC_RELAXED) : 0;
+}
+#endif //DEBUG_MOD_PIPE
@@ -0,0 +1,217 @@
+///@file
+///@brief	Scoped tracing implementation
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _GNU_SOURCE	//for clock_gettime(), syscall()
+
+#include <debug_mod_trace.h>
+
+#ifdef DEBUG_MOD_TRACE
+
+#include "debug_mod_internal.h"
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+
+#ifndef DEBUG_MOD_TRACE_THREADS
+/// Number of threads which can record events
+#define DEBUG_MOD_TRACE_THREADS 8
+#endif
+
+#ifndef DEBUG_MOD_TRACE_EVENTS
+/// Number of events which can be recorded per thread
+#define DEBUG_MOD_TRACE_EVENTS 4096
+#endif
+
+
+
+/// Single recorded trace event
+struct trace_event {
+    /// Monotonic timestamp in nanoseconds
+    uint64_t		ts;
+    /// Name of the traced scope
+    const char*		context;
+    /// Module identifier, used as event category
+    const char*		module;
+    /// Event phase, 'B' for begin or 'E' for end
+    char		phase;
+};
+
+/// Event storage owned by a single thread
+struct trace_buffer {
+    /// Thread identifier for the output
+    long		tid;
+    /// Number of valid events, only written by the owning thread
+    unsigned		count;
+    /// Number of events lost because the buffer was full
+    unsigned long	dropped;
+    /// Recorded events
+    struct trace_event	events[DEBUG_MOD_TRACE_EVENTS];
+};
+
+
+/// Statically allocated buffers for all threads
+static struct trace_buffer buffers[DEBUG_MOD_TRACE_THREADS];
+/// Number of buffers claimed so far
+static unsigned buffers_used = 0;
+
+/// Buffer claimed by the current thread
+static __thread struct trace_buffer* own = NULL;
+/// Set when the current thread found no free buffer
+static __thread char exhausted = 0;
+
+
+
+/// Claim a buffer for the calling thread on its first event
+static struct trace_buffer*
+trace_claim(void)
+{
+    unsigned i;
+
+    if (exhausted) return NULL;
+
+    i = __atomic_fetch_add(&buffers_used, 1, __ATOMIC_RELAXED);
+    if (i >= DEBUG_MOD_TRACE_THREADS) {
+	exhausted = 1;
+	return NULL;
+    }
+    own = buffers + i;
+#ifdef __linux__
+    own->tid = syscall(SYS_gettid);
+#else
+    own->tid = i + 1;
+#endif
+    return own;
+}
+
+
+
+/// Append an event to the calling thread's buffer
+static inline void
+trace_record(const debug_mod* self,
+	     const char* context,
+	     char phase)
+{
+    struct trace_buffer* b = own ? own : trace_claim();
+    struct trace_event* e;
+
+    if (! b) return;
+    if (b->count >= DEBUG_MOD_TRACE_EVENTS) {
+	++b->dropped;
+	return;
+    }
+
+    e = b->events + b->count;
+    e->ts = debug_mod_now();
+    e->context = context;
+    e->module = self->module;
+    e->phase = phase;
+    // Publish the complete event to concurrent dumps
+    __atomic_store_n(&b->count, b->count + 1, __ATOMIC_RELEASE);
+}
+
+
+
+const debug_mod*
+debug_mod_trace_begin(const debug_mod* self,
+		      const char* context)
+{
+    trace_record(self, context, 'B');
+    return self;
+}
+
+
+
+void
+debug_mod_trace_end(const debug_mod* self,
+		    const char* context)
+{
+    trace_record(self, context, 'E');
+}
+
+
+
+/// Write a string with JSON escaping applied
+static void
+trace_json_string(FILE* stream,
+		  const char* s)
+{
+    fputc('"', stream);
+    for (; s && *s; ++s) {
+	if (*s == '"' || *s == '\\') {
+	    fputc('\\', stream);
+	    fputc(*s, stream);
+	} else if ((unsigned char) *s < 0x20) {
+	    fprintf(stream, "\\u%04x", (unsigned char) *s);
+	} else fputc(*s, stream);
+    }
+    fputc('"', stream);
+}
+
+
+
+unsigned long
+debug_mod_trace_dump(FILE* stream)
+{
+    unsigned used = __atomic_load_n(&buffers_used, __ATOMIC_RELAXED);
+    unsigned long written = 0;
+    const char* separator = "\n";
+    long pid = getpid();
+
+    if (! stream) return 0;
+    if (used > DEBUG_MOD_TRACE_THREADS) used = DEBUG_MOD_TRACE_THREADS;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", stream);
+    for (unsigned t = 0; t < used; ++t) {
+	const struct trace_buffer* b = buffers + t;
+	unsigned count = __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+
+	for (unsigned i = 0; i < count; ++i) {
+	    const struct trace_event* e = b->events + i;
+
+	    fputs(separator, stream);
+	    fputs("{\"name\":", stream);
+	    trace_json_string(stream, e->context);
+	    fputs(",\"cat\":", stream);
+	    trace_json_string(stream, e->module);
+	    // Timestamps are given in microseconds
+	    fprintf(stream, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%ld,\"tid\":%ld}",
+		    e->phase, (unsigned long long) (e->ts / 1000),
+		    (unsigned) (e->ts % 1000), pid, b->tid);
+	    separator = ",\n";
+	    ++written;
+	}
+	if (b->dropped) {
+	    fprintf(stream, "%s{\"name\":\"dropped\",\"ph\":\"M\",\"pid\":%ld,"
+		    "\"tid\":%ld,\"args\":{\"events\":%lu}}",
+		    separator, pid, b->tid, b->dropped);
+	    separator = ",\n";
+	}
+    }
+    fputs("\n]}\n", stream);
+
+    return written;
+}
+#endif //DEBUG_MOD_TRACE
@@ -0,0 +1,146 @@
+///@file
+///@brief	Decompressor for output from the compressing sink
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  It reads a stream written
+/// through debug_mod_lz_open() from standard input and writes the
+/// original output to standard output.  An incomplete trailing block,
+/// e.g. after a crash, ends the output without an error.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#include "debug_mod_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/// Largest block size accepted from the stream header
+#define MAX_BLOCK	(64 * 1024)
+/// Largest compressed size of a block in the worst case
+#define BLOCK_BOUND	(MAX_BLOCK + MAX_BLOCK / 255 + 16)
+
+
+
+/// Decode a length extension following a token field
+///
+///@return Zero on success, non-zero if the input ended prematurely
+static int
+unlz_length(const unsigned char** src,
+	    const unsigned char* end,
+	    size_t* len)
+{
+    unsigned char b;
+
+    do {
+	if (*src >= end) return -1;
+	b = *(*src)++;
+	*len += b;
+    } while (b == 255);
+    return 0;
+}
+
+
+
+/// Decompress one block in LZ4 block format
+///
+///@return Size of the decompressed data or negative on corrupt input
+static long
+unlz_block(const unsigned char* src,
+	   size_t size,
+	   unsigned char* dst,
+	   size_t capacity)
+{
+    const unsigned char* end = src + size;
+    size_t pos = 0;
+
+    while (src < end) {
+	unsigned token = *src++;
+	size_t len = token >> 4;
+	size_t offset;
+
+	// Literals
+	if (len == 15 && unlz_length(&src, end, &len)) return -1;
+	if (len > (size_t) (end - src) || len > capacity - pos) return -1;
+	memcpy(dst + pos, src, len);
+	src += len;
+	pos += len;
+	if (src == end) break;		//final literals
+
+	// Match
+	if (end - src < 2) return -1;
+	offset = src[0] | src[1] << 8;
+	src += 2;
+	len = token & 15;
+	if (len == 15 && unlz_length(&src, end, &len)) return -1;
+	len += 4;
+	if (! offset || offset > pos || len > capacity - pos) return -1;
+	// Copy byte by byte, source and destination may overlap
+	for (; len; --len, ++pos) dst[pos] = dst[pos - offset];
+    }
+    return pos;
+}
+
+
+
+/// Decompress standard input to standard output
+int
+main(void)
+{
+    static unsigned char in[BLOCK_BOUND], out[MAX_BLOCK];
+    unsigned char header[8];
+    uint32_t block, size;
+
+    if (fread(header, sizeof(header), 1, stdin) != 1
+	|| memcmp(header, DEBUG_MOD_LZ_MAGIC, 4)) {
+	fputs("debug_mod_unlz: not a compressed debug stream\n", stderr);
+	return EXIT_FAILURE;
+    }
+    block = debug_mod_lz_get32(header + 4);
+    if (block > MAX_BLOCK) {
+	fputs("debug_mod_unlz: unsupported block size\n", stderr);
+	return EXIT_FAILURE;
+    }
+
+    while (fread(header, 4, 1, stdin) == 1) {
+	long n;
+
+	size = debug_mod_lz_get32(header);
+	if (! size) return EXIT_SUCCESS;	//end of stream
+
+	if ((size & ~DEBUG_MOD_LZ_RAW) > (size & DEBUG_MOD_LZ_RAW ? block : BLOCK_BOUND)) {
+	    fputs("debug_mod_unlz: corrupt block header\n", stderr);
+	    return EXIT_FAILURE;
+	}
+	if (fread(in, size & ~DEBUG_MOD_LZ_RAW, 1, stdin) != 1) break;
+
+	if (size & DEBUG_MOD_LZ_RAW) {
+	    fwrite(in, size & ~DEBUG_MOD_LZ_RAW, 1, stdout);
+	    continue;
+	}
+	n = unlz_block(in, size, out, block);
+	if (n < 0) {
+	    fputs("debug_mod_unlz: corrupt block data\n", stderr);
+	    return EXIT_FAILURE;
+	}
+	fwrite(out, n, 1, stdout);
+    }
+
+    fputs("debug_mod_unlz: stream truncated\n", stderr);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+///@file
+///@brief	Crash drain test program
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  It writes debug output to a
+/// fully buffered file and then aborts.  The output must nevertheless
+/// end up in the file, followed by the marker line of the crash
+/// handler.  With DEBUG_MOD_DEDUP, a storm of repeated lines is cut
+/// short by the crash, whose count must be reported as well.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _XOPEN_SOURCE 700	//for sigaltstack()
+
+#include <debug_mod_control.h>
+#include <debug_mod_sink.h>
+
+#include <signal.h>
+#include <stdlib.h>
+
+
+
+// Lazy initialization using source file name as identifier
+DEBUG_MOD_INIT(__FILE__)
+
+
+
+/// Test program for the crash handler
+int
+main(void)
+{
+    FILE* log = fopen("test_crash.txt", "w");
+    static char own_stack[64 * 1024];
+    stack_t ss = { .ss_sp = own_stack, .ss_size = sizeof(own_stack), .ss_flags = 0 };
+
+    // An alternate stack installed before must be left alone
+    if (! log || sigaltstack(&ss, NULL) || debug_mod_crash_install()) return EXIT_FAILURE;
+    if (sigaltstack(NULL, &ss) || ss.ss_sp != own_stack) return EXIT_FAILURE;
+    setvbuf(log, NULL, _IOFBF, BUFSIZ);
+
+    debug_mod_register_self();
+    debug_mod_set_func(debug_mod_always);
+    debug_mod_set_stream(log);
+
+    for (int i = 0; i < 3; ++i) {
+	DEBUGF(fprintf, "line %d before crash\n", i);
+    }
+
+#if defined(DEBUG_MOD_DEDUP) && defined(DEBUG_MOD_FANOUT) && defined(DEBUG_MOD_LZ)
+    // Crash during a storm, the repetitions must still be reported and
+    // the incomplete compressed block must be written out
+    FILE* fanout = debug_mod_fanout_open();
+    FILE* packed = fopen("test_crash.lz", "w");
+
+    if (! fanout || ! packed) return EXIT_FAILURE;
+    debug_mod_fanout_add(fanout, debug_mod_dedup_open(log));
+    debug_mod_fanout_add(fanout, debug_mod_lz_open(packed));
+    debug_mod_set_stream(fanout);
+    for (int i = 0; i < 5; ++i) {
+	DEBUGF(fprintf, "retrying\n");
+    }
+#endif
+
+    abort();
+}
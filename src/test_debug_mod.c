@@ -101,18 +101,19 @@ test_local(void)
 
     // Test configuration saving
 #ifdef DEBUG_MOD_SAVE
-    debug_mod_index_t size, i;
+    debug_mod_index_t size, saved, i;
     debug_mod foo[debug_mod_max];
     debug_mod *const *bars;
 
-    debug_mod_save(foo, sizeof(foo) / sizeof(*foo));
+    saved = debug_mod_save(foo, sizeof(foo) / sizeof(*foo));
     bars = debug_mod_list(&size);
     for (i = 0; i < size && i < sizeof(foo) / sizeof(*foo); ++i) {
 	if (bars[i] && memcmp(bars[i], foo + i, sizeof(debug_mod)) == 0) {
 	    DEBUGF(fprintf, "match %d\n", i);
 	}
     }
-    debug_mod_restore(foo, sizeof(foo) / sizeof(*foo));
+    // Only restore valid entries, foo goes out of scope afterwards
+    debug_mod_restore(foo, saved);
 #endif
 
     // Disable output for this module
@@ -138,5 +139,34 @@ main(void)
     debug_mod_default_func = context;
     test_local();
 
+#ifdef DEBUG_MOD_UNREGISTER
+    // Release a slot again, it is reused for the next registration
+    debug_mod plugin = { verbose, stderr, "plugin" };
+    debug_mod other = { verbose, stderr, "other" };
+    debug_mod_register(&plugin);
+#ifdef DEBUG_MOD_SAVE
+    debug_mod_index_t size, slot;
+    debug_mod *const *bars = debug_mod_list(&size);
+    for (slot = 0; slot < size && bars[slot] != &plugin; ++slot) ;
+#endif
+    debug_mod_unregister(&plugin);
+    if (! debug_mod_unregister(&plugin) && ! debug_mod_unregister(NULL)) {
+	fputs("released module and NULL rejected\n", stderr);
+    }
+    debug_mod_register(&other);
+#ifdef DEBUG_MOD_SAVE
+    if (slot < size && bars[slot] == &other) fputs("released slot reused\n", stderr);
+#endif
+    debug_mod_unregister(&other);
+#endif
+
+#ifdef DEBUG_MOD_COMMAND
+    // Control modules through text commands, like from a console
+    debug_mod_command("test_* +stderr; -test_ext_module.c\nlist", stderr);
+    // Erroneous batches are not applied at all
+    debug_mod_command("-all; bogus.c +", stderr);
+    DEBUGF(fprintf, "still enabled after failed batch\n");
+#endif
+
     return 0;
 }
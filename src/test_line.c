@@ -0,0 +1,96 @@
+///@file
+///@brief	Line assembly test program
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  Several threads write lines to
+/// the same stream, with a prefix written in pieces by the output
+/// prepare function.  With DEBUG_MOD_LINE, every line must come out
+/// whole.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _POSIX_C_SOURCE 200809L	//for pthread_barrier_wait()
+
+#include <debug_mod_control.h>
+
+#include <pthread.h>
+
+
+/// Number of writing threads
+#define THREADS	4
+/// Number of lines per thread
+#define LINES	10000
+
+
+
+// Lazy initialization using source file name as identifier
+DEBUG_MOD_INIT(__FILE__)
+
+
+/// Start all threads at once to provoke interleaving
+static pthread_barrier_t start;
+
+
+
+///@brief Prefix debug output with function context, piece by piece
+///@see debug_mod_f
+static char
+context(debug_mod* restrict self,
+	const char* restrict context)
+{
+    fputs(context, self->stream);
+    fputs("()", self->stream);
+    fputc('\t', self->stream);
+    return 1;
+}
+
+
+
+/// Thread entry point, writes numbered lines
+static void*
+worker(void* arg)
+{
+    long id = (long) arg;
+
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < LINES; ++i) {
+	DEBUGF(fprintf, "thread %ld line %d\n", id, i);
+    }
+    return NULL;
+}
+
+
+
+/// Test program for line assembly
+int
+main(void)
+{
+    pthread_t threads[THREADS];
+
+    debug_mod_register_self();
+    debug_mod_set_func(context);
+    debug_mod_set_stream(stdout);
+
+    pthread_barrier_init(&start, NULL, THREADS);
+    for (long i = 0; i < THREADS; ++i) {
+	pthread_create(threads + i, NULL, worker, (void*) i);
+    }
+    for (int i = 0; i < THREADS; ++i) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&start);
+    return 0;
+}
@@ -0,0 +1,340 @@
+///@file
+///@brief	Output sink test program
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  It routes debug output through
+/// the optional output sinks provided by the library, as far as they
+/// were enabled during compilation.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#define _POSIX_C_SOURCE 200809L	//for dup(), nanosleep()
+
+#include <debug_mod_sink.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+// Lazy initialization using source file name as identifier
+DEBUG_MOD_INIT(__FILE__)
+
+
+
+///@brief Prefix debug output with function context
+///@see debug_mod_f
+static char
+context(debug_mod* restrict self,
+	const char* restrict context)
+{
+    fputs(context, self->stream);
+    fputs("()\t", self->stream);
+    return 1;
+}
+
+
+
+/// Write some numbered lines through the current module stream
+static void
+test_lines(int count)
+{
+    for (int i = 0; i < count; ++i) {
+	DEBUGF(fprintf, "line %d\n", i);
+    }
+}
+
+
+
+#ifdef DEBUG_MOD_ASYNC
+/// Write through an asynchronous sink to standard output
+static void
+test_async(void)
+{
+    FILE* sink = debug_mod_async_open(dup(STDOUT_FILENO));
+    unsigned long dropped;
+
+    if (! sink) return;
+    fflush(stdout);
+
+    debug_mod_set_stream(sink);
+    test_lines(5);
+    debug_mod_set_stream(stderr);
+
+    dropped = debug_mod_async_dropped(sink);
+    fclose(sink);
+    printf("async dropped %lu\n", dropped);
+}
+
+
+
+/// Leave an asynchronous sink open, its output must be written at exit
+static void
+test_async_exit(void)
+{
+    FILE* sink = debug_mod_async_open(open("test_sink.exit",
+					   O_WRONLY | O_CREAT | O_TRUNC, 0644));
+
+    if (! sink) return;
+    debug_mod_set_stream(sink);
+    test_lines(5);
+    debug_mod_set_stream(stderr);
+}
+#endif
+
+
+
+#ifdef DEBUG_MOD_LZ
+/// Write the same lines compressed and uncompressed to files for comparison
+static void
+test_lz(void)
+{
+    FILE* plain = fopen("test_sink.txt", "w");
+    FILE* packed = fopen("test_sink.lz", "w");
+    FILE* sink = debug_mod_lz_open(packed);
+
+    if (! plain || ! sink) return;
+
+    debug_mod_set_stream(plain);
+    test_lines(5000);
+    debug_mod_set_stream(sink);
+    test_lines(5000);
+    debug_mod_set_stream(stderr);
+
+    fclose(sink);
+    fclose(packed);
+    fclose(plain);
+}
+#endif
+
+
+
+#ifdef DEBUG_MOD_FANOUT
+/// Write to standard output and a file at once, then only to the file
+static void
+test_fanout(void)
+{
+    FILE* sink = debug_mod_fanout_open();
+    FILE* file = fopen("test_sink.fan", "w");
+
+    if (! sink || ! file) return;
+    fflush(stdout);
+    debug_mod_fanout_add(sink, stdout);
+    debug_mod_fanout_add(sink, file);
+
+    debug_mod_set_stream(sink);
+    test_lines(2);
+    debug_mod_fanout_enable(sink, stdout, 0);
+    DEBUGF(fprintf, "only in file\n");
+    debug_mod_set_stream(stderr);
+
+    fclose(sink);
+    fclose(file);
+}
+#endif
+
+
+
+#ifdef DEBUG_MOD_DEDUP
+/// Write a storm of identical lines to a file, only one must remain
+static void
+test_dedup(void)
+{
+    FILE* file = fopen("test_sink.dup", "w");
+    FILE* sink = debug_mod_dedup_open(file);
+
+    if (! sink) return;
+
+    debug_mod_set_stream(sink);
+    for (int i = 0; i < 1000; ++i) {
+	DEBUGF(fprintf, "retrying\n");
+    }
+    DEBUGF(fprintf, "done\n");
+    debug_mod_set_stream(stderr);
+
+    fclose(sink);
+    fclose(file);
+}
+#endif
+
+
+
+#ifdef DEBUG_MOD_PIPE
+/// Write to a pipe nobody reads from, then catch up and check the report
+///
+///@return Zero if the drops were reported and the right lines kept
+static int
+test_pipe(debug_mod_pipe_policy policy,
+	  const char* name)
+{
+    static char text[256 * 1024];
+    size_t len = 0;
+    ssize_t n;
+    unsigned long dropped;
+    int fds[2], kept;
+    FILE* sink;
+
+    text[0] = '\0';
+    if (pipe(fds)) return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    sink = debug_mod_pipe_open(fds[1], policy);
+    if (! sink) return -1;
+
+    // Must not block although the pipe is full
+    debug_mod_set_stream(sink);
+    test_lines(10000);
+    for (int i = 0; i < 10 && ! strstr(text, "dropped"); ++i) {
+	while ((n = read(fds[0], text + len, sizeof(text) - 1 - len)) > 0) len += n;
+	text[len] = '\0';
+	DEBUGF(fprintf, "catching up\n");
+    }
+    debug_mod_set_stream(stderr);
+
+    dropped = debug_mod_pipe_dropped(sink);
+    fclose(sink);
+    while ((n = read(fds[0], text + len, sizeof(text) - 1 - len)) > 0) len += n;
+    text[len] = '\0';
+    close(fds[0]);
+
+    kept = strstr(text, "line 9999\n") != NULL;
+    printf("pipe %s dropped %lu bytes, newest line %s\n",
+	   name, dropped, kept ? "kept" : "dropped");
+    if (! dropped || ! strstr(text, "*** debug_mod: dropped ")) return -1;
+    return kept != (policy == DEBUG_MOD_PIPE_DROP_OLDEST);
+}
+
+
+
+/// Consumer thread starting late, counts the lines until end of file
+static void*
+pipe_reader(void* arg)
+{
+    int fd = *(int*) arg;
+    static char chunk[4096];
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 100000000L };
+    unsigned long lines = 0;
+    ssize_t n;
+
+    nanosleep(&delay, NULL);
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+	for (ssize_t i = 0; i < n; ++i) lines += chunk[i] == '\n';
+    }
+    return (void*) lines;
+}
+
+
+
+/// Write more than fits through a blocking sink, nothing may be lost
+///
+///@return Zero if all lines arrived and the descriptor mode was restored
+static int
+test_pipe_block(void)
+{
+    int fds[2];
+    pthread_t reader;
+    void* lines;
+    FILE* sink;
+    unsigned long dropped;
+
+    if (pipe(fds)) return -1;
+    // Share the open file description with the descriptor kept here
+    sink = debug_mod_pipe_open(dup(fds[1]), DEBUG_MOD_PIPE_BLOCK);
+    if (! sink) return -1;
+    pthread_create(&reader, NULL, pipe_reader, fds);
+
+    debug_mod_set_stream(sink);
+    test_lines(20000);
+    debug_mod_set_stream(stderr);
+    dropped = debug_mod_pipe_dropped(sink);
+    fclose(sink);
+
+    if (fcntl(fds[1], F_GETFL) & O_NONBLOCK) return -1;
+    close(fds[1]);
+    pthread_join(reader, &lines);
+    close(fds[0]);
+
+    printf("pipe block dropped %lu bytes, %lu lines arrived\n",
+	   dropped, (unsigned long) lines);
+    return dropped || (unsigned long) lines != 20000;
+}
+#endif
+
+
+
+#ifdef DEBUG_MOD_FILE
+/// Write to the module's own file, rotating it in between
+///
+///@return Zero if the module file was selected
+static int
+test_file(void)
+{
+    // Per-module file test_sink.c.log in the current directory
+    if (debug_mod_file_select(NULL, "./") != 1) return -1;
+    test_lines(3);
+    debug_mod_file_flush();
+
+    // Rotate like logrotate, the next output goes to a fresh file
+    rename("test_sink.c.log", "test_sink.c.log.1");
+    debug_mod_file_sighup();
+    raise(SIGHUP);
+    test_lines(2);
+    debug_mod_set_stream(stderr);
+    return 0;
+}
+#endif
+
+
+
+/// Test program for output sinks
+int
+main(void)
+{
+    debug_mod_register_self();
+    debug_mod_set_func(context);
+
+#ifdef DEBUG_MOD_ASYNC
+    test_async();
+#endif
+#ifdef DEBUG_MOD_LZ
+    test_lz();
+#endif
+#ifdef DEBUG_MOD_FANOUT
+    test_fanout();
+#endif
+#ifdef DEBUG_MOD_DEDUP
+    test_dedup();
+#endif
+#ifdef DEBUG_MOD_PIPE
+    if (test_pipe(DEBUG_MOD_PIPE_DROP_NEWEST, "drop-newest")
+	|| test_pipe(DEBUG_MOD_PIPE_DROP_OLDEST, "drop-oldest")
+	|| test_pipe_block()) return EXIT_FAILURE;
+#endif
+#ifdef DEBUG_MOD_FILE
+    if (test_file()) return EXIT_FAILURE;
+#endif
+#ifdef DEBUG_MOD_ASYNC
+    test_async_exit();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+///@file
+///@brief	Representative call sites for code size measurement
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  It is only compiled to an
+/// object file by test_size.sh, never linked.  Each size_*() function
+/// wraps one call site pattern around the same call to work(), so the
+/// difference to size_none() is the cost of that pattern.  Without
+/// DEBUG_MOD_ENABLE, all of them must compile to the same code.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#include <debug_mod.h>
+
+
+/// Keep the measured functions separate and comparable
+#define SITE __attribute__((noinline))
+
+
+
+// Lazy initialization, measured through the _debug_mod* symbols
+DEBUG_MOD_INIT(__FILE__)
+
+
+
+/// Some application code surrounding the call sites, defined elsewhere
+void work(int x);
+
+
+
+/// Reference without any debug output
+SITE void
+size_none(int x)
+{
+    work(x);
+}
+
+
+
+/// Fixed string output
+SITE void
+size_debugl(int x)
+{
+    work(x);
+    DEBUGL(fputs, "fixed text\n");
+}
+
+
+
+/// Formatted output with one argument
+SITE void
+size_debugf(int x)
+{
+    work(x);
+    DEBUGF(fprintf, "x = %d\n", x);
+}
+
+
+
+/// Formatted output with several arguments
+SITE void
+size_debugf3(int x)
+{
+    work(x);
+    DEBUGF(fprintf, "x = %d, %d, %d\n", x, x + 1, x + 2);
+}
+
+
+
+/// Two sites in the same function, should cost twice a single one
+SITE void
+size_debugf2(int x)
+{
+    work(x);
+    DEBUGF(fprintf, "first x = %d\n", x);
+    DEBUGF(fprintf, "second x = %d\n", x);
+}
+
+
+
+/// Conditional block guarded by the module configuration
+SITE void
+size_enabled(int x)
+{
+    work(x);
+    if (DEBUG_ENABLED) work(-x);
+}
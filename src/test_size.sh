@@ -0,0 +1,202 @@
+#!/bin/sh
+
+# Copyright (C) 2014  Andre Colomb
+#
+# This file is part of libdebugmod.
+#
+# libdebugmod is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# libdebugmod is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this program.  If not, see
+# <http://www.gnu.org/licenses/>.
+
+
+# Code size regression check for the debug output macros.
+#
+# Usage: test_size.sh [-u] [BASELINE]
+#
+# Compiles test_size.c at -O1, -O2 and -Os, with debugging disabled,
+# enabled, and enabled with DEBUG_MOD_UNREGISTER, DEBUG_MOD_LINE or
+# DEBUG_MOD_SDT, as well as disabled with DEBUG_MOD_SDT.  This is done
+# for the host compiler ($CC, default cc) and additionally for avr-gcc
+# if it is found in $PATH ($AVR_MCU, default atmega328p).  For each
+# call site pattern, the text bytes and instruction count in excess of
+# the reference function size_none() are measured.  The DEBUG_MOD_INIT()
+# cost is the total of all _debug_mod* symbols.  Values are keyed by
+# the compiler's target machine and version, e.g. x86_64-linux-gnu-12.2.0.
+#
+# Any cost with debugging disabled (without probes) is an error.
+# Otherwise, values above the stored BASELINE (default
+# test_size.baseline) are reported as regressions, as are values
+# missing for a compiler which has a baseline.  Compilers without any
+# baseline values are only warned about.  With -u, the values of the
+# measured compilers in the baseline are rewritten instead, keeping
+# those of other compilers.
+
+
+cd "$(dirname "$0")"
+
+update=
+if [ "$1" = -u ]; then
+    update=1
+    shift
+fi
+baseline=${1:-test_size.baseline}
+
+CC=${CC:-cc}
+NM=${NM:-nm}
+OBJDUMP=${OBJDUMP:-objdump}
+AVR_MCU=${AVR_MCU:-atmega328p}
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+
+# Print the baseline key of a compiler, its target machine and version
+compiler_key() {
+    machine=$($1 -dumpmachine) || return 1
+    version=$($1 -dumpfullversion 2> /dev/null || $1 -dumpversion) || return 1
+    echo "$machine-$version"
+}
+
+
+# Print "key opt config site metric value" lines for one compiler
+# Arguments: key cc nm objdump [extra compiler flags]
+measure() {
+    key=$1 cc=$2 nm=$3 objdump=$4
+    shift 4
+
+    for opt in -O1 -O2 -Os; do
+	for config in disabled enabled unregister line sdt disabled-sdt; do
+	    case $config in
+		disabled)	defs= ;;
+		enabled)	defs=-DDEBUG_MOD_ENABLE ;;
+		unregister)	defs="-DDEBUG_MOD_ENABLE -DDEBUG_MOD_UNREGISTER" ;;
+		line)		defs="-DDEBUG_MOD_ENABLE -DDEBUG_MOD_LINE" ;;
+		sdt)		defs="-DDEBUG_MOD_ENABLE -DDEBUG_MOD_SDT" ;;
+		disabled-sdt)	defs=-DDEBUG_MOD_SDT ;;
+	    esac
+	    obj="$tmp/$key$opt-$config.o"
+
+	    # No identical code folding, the functions must stay apart
+	    $cc "$@" $opt $defs -std=c99 -Wall -Wextra -Werror -fno-ipa-icf \
+		-I../include -c test_size.c -o "$obj" || exit 1
+
+	    { $nm -S "$obj" && echo "--" && $objdump -d --no-show-raw-insn "$obj"; } \
+		| awk -v prefix="$key $opt $config" '
+		function hex(s,    i, v) {
+		    v = 0
+		    s = tolower(s)
+		    for (i = 1; i <= length(s); ++i) {
+			v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+		    }
+		    return v
+		}
+		$0 == "--" { disasm = 1; next }
+		! disasm && NF == 4 { bytes[$4] = hex($2); next }
+		disasm && /^[0-9a-f]+ <.*>:$/ {
+		    fn = $2
+		    gsub(/[<>:]/, "", fn)
+		    end = hex($1) + bytes[fn]
+		    next
+		}
+		# Only count up to the symbol size, excluding alignment padding
+		disasm && /^ *[0-9a-f]+:\t/ && NF > 1 {
+		    if (hex(substr($1, 1, length($1) - 1)) < end) insns[fn]++
+		}
+		END {
+		    for (fn in bytes) {
+			if (fn ~ /^_debug_mod/) {
+			    init_bytes += bytes[fn]
+			    init_insns += insns[fn]
+			} else if (fn ~ /^size_/ && fn != "size_none") {
+			    site = substr(fn, 6)
+			    printf "%s %s bytes %d\n", prefix, site, bytes[fn] - bytes["size_none"]
+			    printf "%s %s insns %d\n", prefix, site, insns[fn] - insns["size_none"]
+			}
+		    }
+		    printf "%s init bytes %d\n", prefix, init_bytes
+		    printf "%s init insns %d\n", prefix, init_insns
+		}' || exit 1
+	done
+    done
+}
+
+
+host=$(compiler_key "$CC") || exit 1
+measure "$host" "$CC" "$NM" "$OBJDUMP" > "$tmp/measured" || exit 1
+echo "# $host: $($CC --version | head -n 1)" > "$tmp/compilers"
+if command -v avr-gcc > /dev/null 2>&1; then
+    avr=$(compiler_key avr-gcc) || exit 1
+    measure "$avr" avr-gcc avr-nm avr-objdump -mmcu="$AVR_MCU" >> "$tmp/measured" || exit 1
+    echo "# $avr: $(avr-gcc --version | head -n 1)" >> "$tmp/compilers"
+fi
+sort "$tmp/measured" > "$tmp/current" || exit 1
+if [ ! -s "$tmp/current" ]; then
+    echo "No code size values measured" >&2
+    exit 1
+fi
+
+if [ -n "$update" ]; then
+    # Keep the values of compilers not measured this time
+    if [ -r "$baseline" ]; then
+	awk '
+	NR == FNR { measured[$1] = 1; next }
+	{ key = $1 ~ /^#/ ? substr($2, 1, length($2) - 1) : $1 }
+	! (key in measured)' "$tmp/current" "$baseline" > "$tmp/kept" || exit 1
+    else
+	: > "$tmp/kept"
+    fi
+    sort "$tmp/kept" "$tmp/compilers" "$tmp/current" > "$baseline" || exit 1
+    echo "Baseline $baseline written with $(wc -l < "$tmp/current") values"
+    exit 0
+fi
+
+if [ ! -r "$baseline" ]; then
+    echo "No baseline $baseline, create it with -u" >&2
+    exit 1
+fi
+
+awk '
+NR == FNR {
+    if ($1 !~ /^#/) {
+	base[$1 " " $2 " " $3 " " $4 " " $5] = $6
+	known[$1] = 1
+    }
+    next
+}
+{
+    key = $1 " " $2 " " $3 " " $4 " " $5
+    ++checked
+    if ($3 == "disabled" && $6 != 0) {
+	print "FAIL: " key " is " $6 ", must be zero with debugging disabled"
+	++failed
+    } else if (! ($1 in known)) {
+	++unknown[$1]
+    } else if (! (key in base)) {
+	print "FAIL: " key " is not in the baseline"
+	++failed
+    } else if ($6 > base[key]) {
+	print "FAIL: " key " grew from " base[key] " to " $6
+	++failed
+    } else if ($6 < base[key]) {
+	++improved
+    }
+}
+END {
+    for (compiler in unknown) {
+	print "Warning: no baseline for " compiler ", " unknown[compiler] " values only checked with debugging disabled"
+    }
+    printf "%d values checked, %d regressions", checked, failed
+    if (improved) printf ", %d improved (consider updating the baseline)", improved
+    printf "\n"
+    exit failed != 0
+}' "$baseline" "$tmp/current"
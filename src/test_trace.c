@@ -0,0 +1,108 @@
+///@file
+///@brief	Scoped tracing test program
+///@copyright	Copyright (C) 2014  Andre Colomb
+///
+/// This file is part of libdebugmod.  It records nested scopes from
+/// two threads and dumps them in Chrome trace-event format to stdout.
+/// Latency statistics for the timed scopes are written to stderr.
+///
+/// libdebugmod is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as
+/// published by the Free Software Foundation, either version 3 of the
+/// License, or (at your option) any later version.
+///
+/// libdebugmod is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public
+/// License along with this program.  If not, see
+/// <http://www.gnu.org/licenses/>.
+///
+///@author	Andre Colomb <src@andre.colomb.de>
+
+
+#include <debug_mod_control.h>
+#include <debug_mod_trace.h>
+
+#include <pthread.h>
+
+
+
+// Lazy initialization using source file name as identifier
+DEBUG_MOD_INIT(__FILE__)
+
+
+
+///@brief Enable output without any prefix
+///@see debug_mod_f
+static char
+pass(debug_mod* restrict self __attribute__((unused)),
+     const char* restrict context __attribute__((unused)))
+{
+    return 1;
+}
+
+
+
+/// Innermost traced function
+static void
+leaf(void)
+{
+    DEBUG_SCOPE();
+}
+
+
+
+/// Traced and timed function with explicit begin and end markers
+static void
+branch(void)
+{
+    DEBUG_TIME_SCOPE();
+    DEBUG_ENTER();
+    leaf();
+    leaf();
+    DEBUG_EXIT();
+}
+
+
+
+/// Thread entry point, traces a few nested calls
+static void*
+worker(void* arg __attribute__((unused)))
+{
+    DEBUG_SCOPE();
+
+    for (int i = 0; i < 3; ++i) branch();
+    return NULL;
+}
+
+
+
+/// Test program for scoped tracing
+int
+main(void)
+{
+    pthread_t thread;
+    unsigned long events;
+
+    // Enable all modules upon lazy initialization
+    debug_mod_default_func = pass;
+
+    pthread_create(&thread, NULL, worker, NULL);
+    worker(NULL);
+    pthread_join(thread, NULL);
+
+    // Disabled modules must not record anything
+    debug_mod_disable_self();
+    leaf();
+
+    events = debug_mod_trace_dump(stdout);
+    fprintf(stderr, "%lu events\n", events);
+#ifdef DEBUG_MOD_HIST
+    debug_mod_hist_dump(stderr);
+#endif
+    // Two threads, each with one worker and three branches of two leaves
+    return events != 2 * (1 + 3 * (1 + 2)) * 2;
+}